@@ -3,13 +3,29 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller supports bus master IDE (as QEMU's PIIX does),
+   transfers are done by DMA, several sectors per command and one
+   interrupt per command.  Otherwise, or if a DMA transfer fails,
+   we fall back to PIO, still several sectors per command but one
+   interrupt per sector.
+
+   Transfers are asynchronous requests (see disk_submit()) queued
+   on their channel.  Each channel has a daemon thread that serves
+   its queue in elevator order, merging requests for consecutive
+   sectors into a single command.  disk_read() and friends submit
+   a request and wait for it. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +44,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from device to memory. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERROR 0x02          /* Transfer failed. */
+#define BMS_INTR 0x04           /* Device raised an interrupt. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +77,38 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors in one READ DMA or WRITE DMA. */
+#define DMA_MAX_SECTORS 256
+
+/* A physical region descriptor, describing one physically
+   contiguous part of a DMA buffer.  A region may not cross a
+   64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the last descriptor. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Maximum number of requests merged into one command. */
+#define MERGE_MAX 16
+
+/* Descriptors per channel: enough for DMA_MAX_SECTORS sectors
+   split at every page boundary, in up to MERGE_MAX buffers. */
+#define PRD_CNT 64
+
+/* Timer ticks a request may wait before it is served ahead of
+   the elevator order. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (TIMER_FREQ * 5)
+
+/* PCI configuration space ports, used to find the bus master
+   registers of the IDE controller. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
 
 /* An ATA device. */
 struct disk {
@@ -57,8 +119,13 @@ struct disk {
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
 
+	bool use_dma;               /* True to transfer by bus master DMA. */
+
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+	long long byte_cnt;         /* Number of bytes transferred. */
+	long long intr_cnt;         /* Number of completion interrupts. */
+	uint64_t wait_cycles;       /* Cycles spent waiting for transfers. */
 };
 
 /* An ATA channel (aka controller).
@@ -66,14 +133,23 @@ struct disk {
 struct channel {
 	char name[8];               /* Name, e.g. "hd0". */
 	uint16_t reg_base;          /* Base I/O port. */
+	uint16_t bm_base;           /* Bus master I/O port, 0 if none. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
+	struct lock lock;           /* Protects queue, fifo and head. */
+	struct list queue;          /* Pending requests, in elevator order. */
+	struct list fifo;           /* Pending requests, oldest first. */
+	struct condition queue_not_empty;   /* Signaled on submission. */
+	uint64_t head;              /* Elevator position, see request_key(). */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
 	struct disk devices[2];     /* The devices on this channel. */
+
+	/* DMA descriptors.  The alignment keeps the table from
+	   crossing a 64 kB boundary, which the controller forbids. */
+	struct prd prdt[PRD_CNT] __attribute__ ((aligned (512)));
 };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -84,8 +160,18 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static uint16_t find_bus_master (void);
+static void disk_transfer (struct disk *, disk_sector_t, void *,
+		size_t cnt, bool write);
+static void disk_daemon (void *channel);
+static bool dma_transfer (struct disk *, disk_sector_t, struct list *batch,
+		size_t cnt, bool write);
+static bool add_prds (struct channel *, int *prd_cnt, uint8_t *, size_t size);
+static void pio_transfer (struct disk *, disk_sector_t, struct list *batch,
+		size_t cnt, bool write);
+
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -99,6 +185,7 @@ static void interrupt_handler (struct intr_frame *);
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = find_bus_master ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -110,16 +197,22 @@ disk_init (void) {
 		switch (chan_no) {
 			case 0:
 				c->reg_base = 0x1f0;
+				c->bm_base = bm_base;
 				c->irq = 14 + 0x20;
 				break;
 			case 1:
 				c->reg_base = 0x170;
+				c->bm_base = bm_base != 0 ? bm_base + 8 : 0;
 				c->irq = 15 + 0x20;
 				break;
 			default:
 				NOT_REACHED ();
 		}
 		lock_init (&c->lock);
+		list_init (&c->queue);
+		list_init (&c->fifo);
+		cond_init (&c->queue_not_empty);
+		c->head = 0;
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
 
@@ -132,8 +225,12 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->use_dma = false;
 
 			d->read_cnt = d->write_cnt = 0;
+			d->byte_cnt = 0;
+			d->intr_cnt = 0;
+			d->wait_cycles = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -150,6 +247,10 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* Start serving requests. */
+		if (c->devices[0].is_ata || c->devices[1].is_ata)
+			thread_create (c->name, PRI_MAX, disk_daemon, c);
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -167,8 +268,10 @@ disk_print_stats (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+				printf ("%s: %lld reads, %lld writes, %lld bytes, "
+						"%lld interrupts, %"PRIu64" cycles waiting (%s)\n",
+						d->name, d->read_cnt, d->write_cnt, d->byte_cnt,
+						d->intr_cnt, d->wait_cycles, d->use_dma ? "DMA" : "PIO");
 		}
 	}
 }
@@ -209,21 +312,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_transfer (d, sec_no, buffer, 1, false);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,27 +322,415 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	disk_transfer (d, sec_no, (void *) buffer, 1, true);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Uses as few disk commands as possible, so this is much
+   faster than reading the sectors one at a time.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
+	disk_transfer (d, sec_no, buffer, cnt, false);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Uses as few disk commands as possible.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer, size_t cnt) {
+	disk_transfer (d, sec_no, (void *) buffer, cnt, true);
+}
 
+/* Initializes R as a request to transfer CNT sectors, at most
+   DISK_REQUEST_MAX, starting at SEC_NO between disk D and BUFFER:
+   from BUFFER to the disk if WRITE is true, otherwise from the
+   disk into BUFFER.  BUFFER must be in kernel memory.  DONE will
+   be called, in a kernel thread, once the transfer is complete;
+   AUX is for its use. */
+void
+disk_request_init (struct disk_request *r, struct disk *d,
+		disk_sector_t sec_no, void *buffer, size_t cnt, bool write,
+		disk_request_func *done, void *aux) {
+	ASSERT (r != NULL);
 	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (buffer != NULL && is_kernel_vaddr (buffer));
+	ASSERT (cnt > 0 && cnt <= DISK_REQUEST_MAX);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (done != NULL);
+
+	r->disk = d;
+	r->sec_no = sec_no;
+	r->buffer = buffer;
+	r->cnt = cnt;
+	r->write = write;
+	r->done = done;
+	r->aux = aux;
+}
+
+/* Returns the position of request R in its channel's elevator
+   order: by device, then by sector. */
+static uint64_t
+request_key (const struct disk_request *r) {
+	return ((uint64_t) r->disk->dev_no << 32) | r->sec_no;
+}
+
+/* Returns true if request A comes before request B in elevator
+   order. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct disk_request *a = list_entry (a_, struct disk_request, elem);
+	const struct disk_request *b = list_entry (b_, struct disk_request, elem);
+	return request_key (a) < request_key (b);
+}
+
+/* Queues request R, which must have been initialized with
+   disk_request_init(), and returns without waiting for it.
+   Requests on a channel are not served in the order submitted,
+   so requests for overlapping sectors are not ordered relative
+   to each other; a caller that cares must wait for the first to
+   complete before submitting the second. */
+void
+disk_submit (struct disk_request *r) {
+	struct channel *c = r->disk->channel;
+
+	r->start = rdtsc ();
+	r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
 
-	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	list_insert_ordered (&c->queue, &r->elem, request_less, NULL);
+	list_push_back (&c->fifo, &r->fifo_elem);
+	cond_signal (&c->queue_not_empty, &c->lock);
 	lock_release (&c->lock);
 }
-
+
+/* Ups the semaphore that is R's auxiliary data. */
+static void
+wake_submitter (struct disk_request *r) {
+	sema_up (r->aux);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, as described for disk_request_init(), and waits for the
+   transfer to complete.  Like a request's, BUFFER must be in kernel
+   memory, because the channel's daemon thread carries out the
+   transfer and cannot see a process's user memory. */
+static void
+disk_transfer (struct disk *d, disk_sector_t sec_no, void *buffer_,
+		size_t cnt, bool write) {
+	uint8_t *buffer = buffer_;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+	ASSERT (is_kernel_vaddr (buffer));
+
+	while (cnt > 0) {
+		size_t chunk = cnt < DISK_REQUEST_MAX ? cnt : DISK_REQUEST_MAX;
+		struct disk_request r;
+		struct semaphore done;
+
+		sema_init (&done, 0);
+		disk_request_init (&r, d, sec_no, buffer, chunk, write,
+				wake_submitter, &done);
+		disk_submit (&r);
+		sema_down (&done);
+
+		sec_no += chunk;
+		buffer += chunk * DISK_SECTOR_SIZE;
+		cnt -= chunk;
+	}
+}
+
+/* Request scheduling. */
+
+/* Removes the next requests to serve from channel C's queues and
+   puts them, in sector order, on BATCH.  Serves the oldest request
+   if it is past its deadline, and otherwise the first request at
+   or after the last position served (C-LOOK), wrapping around to
+   the lowest one.  Adds to it the following queued requests that
+   continue it on the disk, in the same direction, so that one
+   command transfers them all.  C's lock must be held and its
+   queue must not be empty. */
+static void
+pick_requests (struct channel *c, struct list *batch) {
+	struct disk_request *r, *oldest;
+	struct list_elem *e;
+	size_t sector_cnt, request_cnt;
+
+	ASSERT (lock_held_by_current_thread (&c->lock));
+	ASSERT (!list_empty (&c->queue));
+
+	oldest = list_entry (list_front (&c->fifo), struct disk_request, fifo_elem);
+	if (timer_ticks () >= oldest->deadline)
+		r = oldest;
+	else {
+		r = NULL;
+		for (e = list_begin (&c->queue); e != list_end (&c->queue);
+				e = list_next (e)) {
+			struct disk_request *q = list_entry (e, struct disk_request, elem);
+			if (request_key (q) >= c->head) {
+				r = q;
+				break;
+			}
+		}
+		if (r == NULL)
+			r = list_entry (list_front (&c->queue), struct disk_request, elem);
+	}
+
+	sector_cnt = request_cnt = 0;
+	for (;;) {
+		struct disk_request *next = NULL;
+
+		e = list_next (&r->elem);
+		if (e != list_end (&c->queue))
+			next = list_entry (e, struct disk_request, elem);
+
+		list_remove (&r->elem);
+		list_remove (&r->fifo_elem);
+		list_push_back (batch, &r->elem);
+		sector_cnt += r->cnt;
+		request_cnt++;
+		c->head = request_key (r) + r->cnt;
+
+		if (next == NULL || next->disk != r->disk || next->write != r->write
+				|| next->sec_no != r->sec_no + r->cnt
+				|| sector_cnt + next->cnt > DMA_MAX_SECTORS
+				|| request_cnt >= MERGE_MAX)
+			break;
+		r = next;
+	}
+}
+
+/* Per-channel daemon thread.  Serves the requests queued on the
+   channel AUX, one batch at a time, and calls their completion
+   functions. */
+static void
+disk_daemon (void *c_) {
+	struct channel *c = c_;
+
+	for (;;) {
+		struct list batch;
+		struct disk_request *first;
+		size_t cnt = 0;
+		struct list_elem *e;
+
+		list_init (&batch);
+		lock_acquire (&c->lock);
+		while (list_empty (&c->queue))
+			cond_wait (&c->queue_not_empty, &c->lock);
+		pick_requests (c, &batch);
+		lock_release (&c->lock);
+
+		first = list_entry (list_front (&batch), struct disk_request, elem);
+		for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+			cnt += list_entry (e, struct disk_request, elem)->cnt;
+		if (!dma_transfer (first->disk, first->sec_no, &batch, cnt, first->write))
+			pio_transfer (first->disk, first->sec_no, &batch, cnt, first->write);
+
+		while (!list_empty (&batch)) {
+			struct disk_request *r = list_entry (list_pop_front (&batch),
+					struct disk_request, elem);
+			struct disk *d = r->disk;
+
+			if (r->write)
+				d->write_cnt += r->cnt;
+			else
+				d->read_cnt += r->cnt;
+			d->byte_cnt += r->cnt * DISK_SECTOR_SIZE;
+			d->wait_cycles += rdtsc () - r->start;
+			r->done (r);
+		}
+	}
+}
+
+/* Transfers the CNT sectors of the requests in BATCH, which
+   continue one another on disk D starting at SEC_NO and are all
+   reads or all writes as given by WRITE, with a single READ DMA or
+   WRITE DMA command.  Returns false without transferring anything
+   if DMA cannot be used for this disk or these buffers, or if the
+   transfer failed; in the latter case DMA is disabled for D.
+   Called only by the channel's daemon. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no, struct list *batch,
+		size_t cnt, bool write) {
+	struct channel *c = d->channel;
+	uint8_t direction = write ? 0 : BM_READ;
+	uint8_t bm_status;
+	struct list_elem *e;
+	int prd_cnt = 0;
+
+	if (!d->use_dma)
+		return false;
+	for (e = list_begin (batch); e != list_end (batch); e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		if (!add_prds (c, &prd_cnt, r->buffer, r->cnt * DISK_SECTOR_SIZE))
+			return false;
+	}
+	c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+	/* Program the bus master, issue the command, then start the
+	   transfer and wait for the completion interrupt. */
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_command (c), direction);
+	outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+	select_sector (d, sec_no, cnt);
+	issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), direction | BM_START);
+	sema_down (&c->completion_wait);
+	d->intr_cnt++;
+	outb (reg_bm_command (c), direction);
+	bm_status = inb (reg_bm_status (c));
+	outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+
+	if ((bm_status & BMS_ERROR) != 0
+			|| (inb (reg_alt_status (c)) & STA_ERR) != 0) {
+		printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+				d->name, write ? "write" : "read", sec_no);
+		d->use_dma = false;
+		return false;
+	}
+	return true;
+}
+
+/* Appends descriptors for the SIZE bytes of kernel memory at
+   BUFFER to channel C's PRD table, which already has *PRD_CNT
+   entries, and updates *PRD_CNT.  Returns false if the
+   controller cannot reach BUFFER, because it is not word aligned
+   or lies above 4 GB, or if the table is full. */
+static bool
+add_prds (struct channel *c, int *prd_cnt, uint8_t *buffer, size_t size) {
+	if (((uintptr_t) buffer & 1) != 0)
+		return false;
+
+	/* Describe the buffer page by page, merging physically
+	   contiguous pieces.  A page never crosses a 64 kB boundary, so
+	   checking for one only matters when merging. */
+	while (size > 0) {
+		size_t chunk = PGSIZE - pg_ofs (buffer);
+		uint64_t addr = vtop (buffer);
+
+		if (chunk > size)
+			chunk = size;
+		if (addr + chunk > 0x100000000ULL)
+			return false;
+
+		if (*prd_cnt > 0) {
+			struct prd *prev = &c->prdt[*prd_cnt - 1];
+			uint64_t prev_size = prev->size != 0 ? prev->size : 0x10000;
+			if (prev->addr + prev_size == addr
+					&& prev->addr >> 16 == (addr + chunk - 1) >> 16) {
+				prev->size = (prev_size + chunk) & 0xffff;
+				goto next;
+			}
+		}
+		if (*prd_cnt >= PRD_CNT)
+			return false;
+		c->prdt[*prd_cnt].addr = addr;
+		c->prdt[*prd_cnt].size = chunk & 0xffff;
+		c->prdt[*prd_cnt].flags = 0;
+		(*prd_cnt)++;
+next:
+		buffer += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* Transfers the CNT sectors of the requests in BATCH, as
+   described for dma_transfer(), by PIO.  A single READ SECTOR or
+   WRITE SECTOR command covers all the sectors, but the disk
+   raises an interrupt for each one.  Called only by the channel's
+   daemon. */
+static void
+pio_transfer (struct disk *d, disk_sector_t sec_no, struct list *batch,
+		size_t cnt, bool write) {
+	struct channel *c = d->channel;
+	struct list_elem *e;
+
+	select_sector (d, sec_no, cnt);
+	issue_command (c, write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY);
+	for (e = list_begin (batch); e != list_end (batch); e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		uint8_t *p = r->buffer;
+		size_t i;
+
+		for (i = 0; i < r->cnt; i++, sec_no++, p += DISK_SECTOR_SIZE) {
+			if (!write) {
+				sema_down (&c->completion_wait);
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+				input_sector (c, p);
+			} else {
+				if (!wait_while_busy (d))
+					PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+				output_sector (c, p);
+				sema_down (&c->completion_wait);
+			}
+			d->intr_cnt++;
+		}
+	}
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
 
+/* Reads the 32-bit register REG from the PCI configuration space
+   of function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | dev << 11 | func << 8 | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register REG in the PCI
+   configuration space of function FUNC of device DEV on bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | dev << 11 | func << 8 | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks for an IDE controller on PCI bus 0 that supports bus
+   mastering, enables bus mastering on it, and returns the base
+   I/O port of its bus master registers.  Returns 0 if there is
+   no such controller. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class, bar4;
+
+			if ((pci_read_config (dev, func, 0x00) & 0xffff) == 0xffff)
+				continue;
+
+			/* Class 1 (mass storage), subclass 1 (IDE), with bit 7
+			   of the programming interface set if bus mastering is
+			   supported.  BAR4 must be an I/O space BAR. */
+			class = pci_read_config (dev, func, 0x08);
+			bar4 = pci_read_config (dev, func, 0x20);
+			if ((class >> 16) != 0x0101 || (class & 0x8000) == 0
+					|| (bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+				continue;
+
+			/* Enable I/O space decoding and bus mastering. */
+			pci_write_config (dev, func, 0x04,
+					pci_read_config (dev, func, 0x04) | 0x5);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -353,7 +830,7 @@ identify_ata_device (struct disk *d) {
 	   indicating the device's response is ready, and read the data
 	   into our buffer. */
 	select_device_wait (d);
-	issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+	issue_command (c, CMD_IDENTIFY_DEVICE);
 	sema_down (&c->completion_wait);
 	if (!wait_while_busy (d)) {
 		d->is_ata = false;
@@ -364,6 +841,9 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Use DMA if the controller and the disk both support it. */
+	d->use_dma = c->bm_base != 0 && (id[49] & (1 << 8)) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -379,7 +859,7 @@ identify_ata_device (struct disk *d) {
 	print_ata_string ((char *) &id[27], 40);
 	printf ("\", serial \"");
 	print_ata_string ((char *) &id[10], 20);
-	printf ("\"\n");
+	printf ("\"%s\n", d->use_dma ? ", DMA" : "");
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -402,17 +882,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DMA_MAX_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DMA_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -423,7 +904,7 @@ select_sector (struct disk *d, disk_sector_t sec_no) {
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) {
+issue_command (struct channel *c, uint8_t command) {
 	/* Interrupts must be enabled or our semaphore will never be
 	   up'd by the completion handler. */
 	ASSERT (intr_get_level () == INTR_ON);
@@ -541,14 +1022,22 @@ inspect_write_cnt (struct intr_frame *f) {
 	f->R.rax = d->write_cnt;
 }
 
-/* Tool for testing disk r/w cnt. Calling this function via int 0x43 and int 0x44.
+static void
+inspect_intr_cnt (struct intr_frame *f) {
+	struct disk * d = disk_get (f->R.rdx, f->R.rcx);
+	f->R.rax = d->intr_cnt;
+}
+
+/* Tool for testing disk r/w cnt. Calling this function via int 0x43 and int 0x44,
+ * or int 0x45 for the number of disk interrupts.
  * Input:
  *   @RDX - chan_no of disk to inspect
  *   @RCX - dev_no of disk to inspect
  * Output:
- *   @RAX - Read/Write count of disk. */
+ *   @RAX - Read/Write/Interrupt count of disk. */
 void
 register_disk_inspect_intr (void) {
 	intr_register_int (0x43, 3, INTR_OFF, inspect_read_cnt, "Inspect Disk Read Count");
 	intr_register_int (0x44, 3, INTR_OFF, inspect_write_cnt, "Inspect Disk Write Count");
+	intr_register_int (0x45, 3, INTR_OFF, inspect_intr_cnt, "Inspect Disk Interrupt Count");
 }
@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -20,6 +21,9 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Number of TSC cycles spent in the timer interrupt handler. */
+static uint64_t intr_cycles;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -90,6 +94,17 @@ timer_elapsed(int64_t then)
 	return timer_ticks() - then;
 }
 
+/* Returns the number of TSC cycles spent in the timer interrupt
+   handler since the OS booted. */
+uint64_t
+timer_intr_cycles(void)
+{
+	enum intr_level old_level = intr_disable();
+	uint64_t c = intr_cycles;
+	intr_set_level(old_level);
+	return c;
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void timer_sleep(int64_t ticks)
 {
@@ -129,6 +144,8 @@ void timer_print_stats(void)
 static void
 timer_interrupt(struct intr_frame *args UNUSED)
 {
+	uint64_t start = rdtsc();
+
 	ticks++;
 	thread_tick();
 
@@ -142,7 +159,9 @@ timer_interrupt(struct intr_frame *args UNUSED)
 		if ((timer_ticks() % 4) == 0)
 			update_priority();
 	}
-	awake_thread();
+	thread_awake(ticks);
+
+	intr_cycles += rdtsc() - start;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -207,27 +226,3 @@ real_time_sleep(int64_t num, int32_t denom)
 		busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 	}
 }
-
-void awake_thread()
-{
-	int64_t curr_time = timer_ticks();
-	if (curr_time >= next_tick_to_awake)
-	{
-		struct list_elem *e = list_begin(&sleep_list);
-		while (e != list_end(&sleep_list))
-		{
-			struct thread *t = list_entry(e, struct thread, elem);
-			if (curr_time >= t->wakeup_tick)
-			{
-				e = list_remove(e);
-				thread_unblock(t);
-				/* external interrupt happened, so we can't change context */
-			}
-			else
-			{
-				e = list_next(e);
-			}
-		}
-	}
-	update_next_tick_to_awake();
-}
\ No newline at end of file
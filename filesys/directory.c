@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,11 +22,114 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRIES \
+	((DISK_SECTOR_SIZE - sizeof (bool)) / sizeof (struct dir_entry))
+
+/* Number of buckets dir_add() tries before it grows the directory. */
+#define MAX_PROBES 4
+
+/* A directory is a hash table of one-sector buckets.  An entry
+ * lives in the bucket its name hashes to or, if that one was full
+ * when the entry was added, in one of the buckets after it.  So
+ * lookups and insertions usually read a single sector.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_bucket {
+	struct dir_entry entries[BUCKET_ENTRIES]; /* Entries. */
+	bool overflow;                      /* Was ever full when adding? */
+	uint8_t unused[DISK_SECTOR_SIZE - sizeof (bool)
+		- BUCKET_ENTRIES * sizeof (struct dir_entry)];
+};
+
+static bool rehash (struct dir *, size_t bucket_cnt);
+
+/* Directory entry cache.
+
+   Maps a (directory inode sector, name) pair to the inode sector
+   the name refers to, or to NO_SECTOR if the directory has no entry
+   by that name, so that repeated lookups of the same names skip the
+   directory's buckets.  Holds the DCACHE_SIZE most recently used
+   pairs.  dir_add() and dir_remove() keep the cached pairs for the
+   names they change up to date, and dir_create() drops every pair
+   for a directory whose sector is being reused.
+
+   A lookup that misses scans the directory without holding the
+   cache's lock, so a change to the directory may land in between.
+   Every change bumps dcache_gen, and the lookup only caches what it
+   found if dcache_gen is still what it was before the scan. */
+
+/* Number of cached names. */
+#define DCACHE_SIZE 128
+
+/* Inode sector of a name that is not in its directory. */
+#define NO_SECTOR ((disk_sector_t) -1)
+
+/* A cached name. */
+struct dcache_entry {
+	struct hash_elem elem;              /* Element in dcache_map. */
+	struct list_elem lru_elem;          /* Element in dcache_lru. */
+	bool valid;                         /* In dcache_map? */
+	disk_sector_t dir_sector;           /* Directory's inode sector. */
+	char name[NAME_MAX + 1];            /* Name within the directory. */
+	disk_sector_t inode_sector;         /* NAME's inode, or NO_SECTOR. */
+};
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct hash dcache_map;          /* Valid entries. */
+static struct list dcache_lru;          /* All entries, most recent first. */
+static unsigned dcache_gen;             /* Bumped on every change. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+/* Serializes dir_add() and dir_remove(), so that two of them cannot
+ * both find a name absent, or present, and act on it. */
+static struct lock dir_update_lock;
+
+static bool dcache_get (disk_sector_t dir_sector, const char *name,
+		disk_sector_t *inode_sector, unsigned *gen);
+static void dcache_set (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector);
+static void dcache_fill (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector, unsigned gen);
+static void dcache_store (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector);
+static void dcache_purge (disk_sector_t dir_sector);
+static hash_hash_func dcache_hash;
+static hash_less_func dcache_less;
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	size_t bucket_cnt = DIV_ROUND_UP (entry_cnt, BUCKET_ENTRIES);
+
+	/* If this assertion fails, the bucket structure is not exactly
+	 * one sector in size, and you should fix that. */
+	ASSERT (sizeof (struct dir_bucket) == DISK_SECTOR_SIZE);
+
+	if (bucket_cnt == 0)
+		bucket_cnt = 1;
+	dcache_purge (sector);
+	return inode_create (sector, bucket_cnt * sizeof (struct dir_bucket));
+}
+
+/* Returns the number of buckets in DIR. */
+static size_t
+bucket_cnt (const struct dir *dir) {
+	return inode_length (dir->inode) / sizeof (struct dir_bucket);
+}
+
+/* Returns the bucket in which DIR, with BUCKET_CNT buckets, starts
+ * looking for NAME. */
+static size_t
+home_bucket (const char *name, size_t bucket_cnt) {
+	return hash_string (name) % bucket_cnt;
+}
+
+/* Reads bucket IDX of DIR into B.  Returns true if successful. */
+static bool
+read_bucket (const struct dir *dir, size_t idx, struct dir_bucket *b) {
+	return inode_read_at (dir->inode, b, sizeof *b, idx * sizeof *b)
+		== sizeof *b;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -79,22 +185,41 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
-	struct dir_entry e;
-	size_t ofs;
+	struct dir_bucket *b;
+	size_t cnt = bucket_cnt (dir);
+	size_t idx, probe, i;
+	bool found = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
+	if (cnt == 0)
+		return false;
+	b = malloc (sizeof *b);
+	if (b == NULL)
+		return false;
+
+	idx = home_bucket (name, cnt);
+	for (probe = 0; probe < cnt && !found; probe++) {
+		if (!read_bucket (dir, idx, b))
+			break;
+		for (i = 0; i < BUCKET_ENTRIES; i++) {
+			struct dir_entry *e = &b->entries[i];
+			if (e->in_use && !strcmp (name, e->name)) {
+				if (ep != NULL)
+					*ep = *e;
+				if (ofsp != NULL)
+					*ofsp = idx * sizeof *b + i * sizeof *e;
+				found = true;
+				break;
+			}
 		}
-	return false;
+		if (!b->overflow)
+			break;
+		idx = (idx + 1) % cnt;
+	}
+	free (b);
+	return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -106,11 +231,21 @@ dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
 	struct dir_entry e;
 
+	disk_sector_t dir_sector, inode_sector;
+	unsigned gen;
+
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
+	dir_sector = inode_get_inumber (dir->inode);
+	if (!dcache_get (dir_sector, name, &inode_sector, &gen)) {
+		inode_sector = lookup (dir, name, &e, NULL) ? e.inode_sector
+			: NO_SECTOR;
+		dcache_fill (dir_sector, name, inode_sector, gen);
+	}
+
+	if (inode_sector != NO_SECTOR)
+		*inode = inode_open (inode_sector);
 	else
 		*inode = NULL;
 
@@ -125,8 +260,9 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_bucket *b = NULL;
 	struct dir_entry e;
-	off_t ofs;
+	disk_sector_t dir_sector, cached;
 	bool success = false;
 
 	ASSERT (dir != NULL);
@@ -137,28 +273,106 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 		return false;
 
 	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	lock_acquire (&dir_update_lock);
+	dir_sector = inode_get_inumber (dir->inode);
+	if (dcache_get (dir_sector, name, &cached, NULL) ? cached != NO_SECTOR
+			: lookup (dir, name, NULL, NULL))
 		goto done;
 
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
-
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
-
-	/* Write slot. */
+	b = malloc (sizeof *b);
+	if (b == NULL)
+		goto done;
 	e.in_use = true;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
-	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+	/* Find a free slot in NAME's home bucket or one of the few after
+	 * it, marking the full buckets passed over so that lookups go on
+	 * past them.  If there is none, double the number of buckets and
+	 * try again. */
+	for (;;) {
+		size_t cnt = bucket_cnt (dir);
+		size_t idx = cnt > 0 ? home_bucket (name, cnt) : 0;
+		size_t probe, i;
+
+		for (probe = 0; probe < cnt && probe < MAX_PROBES; probe++) {
+			if (!read_bucket (dir, idx, b))
+				goto done;
+			for (i = 0; i < BUCKET_ENTRIES; i++)
+				if (!b->entries[i].in_use) {
+					off_t ofs = idx * sizeof *b + i * sizeof e;
+					success = inode_write_at (dir->inode, &e, sizeof e, ofs)
+						== sizeof e;
+					goto done;
+				}
+			if (!b->overflow) {
+				b->overflow = true;
+				if (inode_write_at (dir->inode, &b->overflow,
+							sizeof b->overflow,
+							idx * sizeof *b + offsetof (struct dir_bucket,
+								overflow)) != sizeof b->overflow)
+					goto done;
+			}
+			idx = (idx + 1) % cnt;
+		}
+		if (!rehash (dir, cnt > 0 ? cnt * 2 : 1))
+			goto done;
+	}
+
+done:
+	if (success)
+		dcache_set (dir_sector, name, inode_sector);
+	lock_release (&dir_update_lock);
+	free (b);
+	return success;
+}
+
+/* Rebuilds DIR with NEW_CNT buckets, which must be more than it
+ * has, moving every entry to its home bucket under the new count
+ * and clearing the overflow marks that are no longer needed.
+ * Returns true if successful, false if memory or disk allocation
+ * fails, in which case DIR is unchanged. */
+static bool
+rehash (struct dir *dir, size_t new_cnt) {
+	size_t old_cnt = bucket_cnt (dir);
+	off_t old_size = old_cnt * sizeof (struct dir_bucket);
+	off_t new_size = new_cnt * sizeof (struct dir_bucket);
+	struct dir_bucket *old, *new;
+	bool success = false;
+	size_t i, j;
+
+	ASSERT (new_cnt > old_cnt);
+
+	old = malloc (old_size > 0 ? old_size : 1);
+	new = calloc (new_cnt, sizeof *new);
+	if (old == NULL || new == NULL
+			|| inode_read_at (dir->inode, old, old_size, 0) != old_size)
+		goto done;
+
+	for (i = 0; i < old_cnt; i++)
+		for (j = 0; j < BUCKET_ENTRIES; j++) {
+			struct dir_entry *e = &old[i].entries[j];
+			size_t idx, k;
+
+			if (!e->in_use)
+				continue;
+			for (idx = home_bucket (e->name, new_cnt); ;
+					idx = (idx + 1) % new_cnt) {
+				for (k = 0; k < BUCKET_ENTRIES; k++)
+					if (!new[idx].entries[k].in_use)
+						break;
+				if (k < BUCKET_ENTRIES)
+					break;
+				new[idx].overflow = true;
+			}
+			new[idx].entries[k] = *e;
+		}
+
+	success = inode_write_at (dir->inode, new, new_size, 0) == new_size;
 
 done:
+	free (old);
+	free (new);
 	return success;
 }
 
@@ -176,6 +390,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	lock_acquire (&dir_update_lock);
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
@@ -188,12 +403,14 @@ dir_remove (struct dir *dir, const char *name) {
 	e.in_use = false;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
+	dcache_set (inode_get_inumber (dir->inode), name, NO_SECTOR);
 
 	/* Remove inode. */
 	inode_remove (inode);
 	success = true;
 
 done:
+	lock_release (&dir_update_lock);
 	inode_close (inode);
 	return success;
 }
@@ -205,7 +422,13 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
 
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	for (;;) {
+		/* Skip the tail of each bucket. */
+		if (dir->pos % sizeof (struct dir_bucket)
+				>= BUCKET_ENTRIES * sizeof e)
+			dir->pos = ROUND_UP (dir->pos, sizeof (struct dir_bucket));
+		if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+			break;
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
@@ -214,3 +437,148 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	}
 	return false;
 }
+
+/* Initializes the directory entry cache. */
+void
+dir_init (void) {
+	size_t i;
+
+	hash_init (&dcache_map, dcache_hash, dcache_less, NULL);
+	list_init (&dcache_lru);
+	lock_init (&dcache_lock);
+	lock_init (&dir_update_lock);
+	for (i = 0; i < DCACHE_SIZE; i++) {
+		dcache[i].valid = false;
+		list_push_back (&dcache_lru, &dcache[i].lru_elem);
+	}
+}
+
+/* Returns a hash value for cached name E. */
+static uint64_t
+dcache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dcache_entry *d = hash_entry (e, struct dcache_entry, elem);
+	return hash_string (d->name) ^ hash_int (d->dir_sector);
+}
+
+/* Returns true if cached name A precedes cached name B. */
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dcache_entry *a = hash_entry (a_, struct dcache_entry, elem);
+	const struct dcache_entry *b = hash_entry (b_, struct dcache_entry, elem);
+	if (a->dir_sector != b->dir_sector)
+		return a->dir_sector < b->dir_sector;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached entry for NAME in the directory whose inode is
+ * in DIR_SECTOR, or a null pointer if there is none.  DCACHE_LOCK
+ * must be held. */
+static struct dcache_entry *
+dcache_find (disk_sector_t dir_sector, const char *name) {
+	struct dcache_entry key;
+	struct hash_elem *e;
+
+	key.dir_sector = dir_sector;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct dcache_entry, elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in DIR_SECTOR in
+ * the cache.  On a hit, stores the sector of NAME's inode, or
+ * NO_SECTOR if the directory has no such entry, into *INODE_SECTOR
+ * and returns true.  Returns false on a miss, after storing the
+ * current generation into *GEN if GEN is non-null, for passing to
+ * dcache_fill(). */
+static bool
+dcache_get (disk_sector_t dir_sector, const char *name,
+		disk_sector_t *inode_sector, unsigned *gen) {
+	struct dcache_entry *d;
+
+	lock_acquire (&dcache_lock);
+	if (gen != NULL)
+		*gen = dcache_gen;
+	if (strlen (name) > NAME_MAX) {
+		lock_release (&dcache_lock);
+		return false;
+	}
+	d = dcache_find (dir_sector, name);
+	if (d != NULL) {
+		*inode_sector = d->inode_sector;
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+	}
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records in the cache that NAME in the directory whose inode is in
+ * DIR_SECTOR now refers to the inode in INODE_SECTOR, or to nothing
+ * if INODE_SECTOR is NO_SECTOR, because the directory was changed. */
+static void
+dcache_set (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector) {
+	lock_acquire (&dcache_lock);
+	dcache_gen++;
+	dcache_store (dir_sector, name, inode_sector);
+	lock_release (&dcache_lock);
+}
+
+/* Records in the cache what a scan of the directory whose inode is
+ * in DIR_SECTOR found for NAME, unless the cache changed since
+ * generation GEN, in which case the scan may have missed a change. */
+static void
+dcache_fill (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector, unsigned gen) {
+	lock_acquire (&dcache_lock);
+	if (gen == dcache_gen)
+		dcache_store (dir_sector, name, inode_sector);
+	lock_release (&dcache_lock);
+}
+
+/* Does the work of dcache_set() and dcache_fill().  Replaces the
+ * least recently used entry if NAME is not cached yet.  DCACHE_LOCK
+ * must be held. */
+static void
+dcache_store (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector) {
+	struct dcache_entry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+	d = dcache_find (dir_sector, name);
+	if (d == NULL) {
+		d = list_entry (list_back (&dcache_lru), struct dcache_entry,
+				lru_elem);
+		if (d->valid)
+			hash_delete (&dcache_map, &d->elem);
+		d->dir_sector = dir_sector;
+		strlcpy (d->name, name, sizeof d->name);
+		d->valid = true;
+		hash_insert (&dcache_map, &d->elem);
+	}
+	d->inode_sector = inode_sector;
+	list_remove (&d->lru_elem);
+	list_push_front (&dcache_lru, &d->lru_elem);
+}
+
+/* Drops every cached name in the directory whose inode is in
+ * DIR_SECTOR. */
+static void
+dcache_purge (disk_sector_t dir_sector) {
+	size_t i;
+
+	lock_acquire (&dcache_lock);
+	dcache_gen++;
+	for (i = 0; i < DCACHE_SIZE; i++) {
+		struct dcache_entry *d = &dcache[i];
+		if (d->valid && d->dir_sector == dir_sector) {
+			hash_delete (&dcache_map, &d->elem);
+			d->valid = false;
+			list_remove (&d->lru_elem);
+			list_push_back (&dcache_lru, &d->lru_elem);
+		}
+	}
+	lock_release (&dcache_lock);
+}
@@ -1,4 +1,5 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -23,6 +24,8 @@ struct fat_fs {
 	unsigned int fat_length;
 	disk_sector_t data_start;
 	cluster_t last_clst;
+	struct bitmap *used_map; /* One bit per cluster, set if in use. */
+	struct bitmap *dirty_map; /* One bit per FAT sector, set if changed. */
 	struct lock write_lock;
 };
 
@@ -30,6 +33,8 @@ static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_maps_init (void);
+static cluster_t fat_allocate (cluster_t near, size_t *cnt);
 
 void
 fat_init (void) {
@@ -53,31 +58,32 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	// Formatting just created the FAT, and it is still in memory
+	if (fat_fs->fat != NULL)
+		return;
+
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT directly from the disk, whole sectors in one transfer
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+	size_t full_sectors = fat_size_in_bytes / DISK_SECTOR_SIZE;
+	off_t bytes_left = fat_size_in_bytes % DISK_SECTOR_SIZE;
+	if (full_sectors > fat_fs->bs.fat_sectors)
+		full_sectors = fat_fs->bs.fat_sectors;
+	disk_read_multiple (filesys_disk, fat_fs->bs.fat_start, buffer,
+	                    full_sectors);
+	if (bytes_left > 0 && full_sectors < fat_fs->bs.fat_sectors) {
+		uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT load failed");
+		disk_read (filesys_disk, fat_fs->bs.fat_start + full_sectors, bounce);
+		memcpy (buffer + full_sectors * DISK_SECTOR_SIZE, bounce, bytes_left);
+		free (bounce);
 	}
+	fat_maps_init ();
 }
 
 void
@@ -90,27 +96,52 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	// Write the changed parts of the FAT
+	fat_sync ();
+}
+
+/* Writes the FAT sectors changed since they were last written to the
+ * disk, each run of consecutive sectors in one transfer.  fat_put()
+ * only updates the FAT in memory, so this runs at sync points:
+ * periodically from the sector cache flusher and in fat_close(). */
+void
+fat_sync (void) {
+	if (fat_fs == NULL || fat_fs->dirty_map == NULL)
+		return;
+
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
+	size_t full_sectors = fat_size_in_bytes / DISK_SECTOR_SIZE;
+	size_t sec, cnt;
+
+	lock_acquire (&fat_fs->write_lock);
+	for (sec = 0; sec < bitmap_size (fat_fs->dirty_map); sec += cnt) {
+		cnt = 1;
+		if (!bitmap_test (fat_fs->dirty_map, sec))
+			continue;
+		while (sec + cnt < bitmap_size (fat_fs->dirty_map)
+		       && bitmap_test (fat_fs->dirty_map, sec + cnt))
+			cnt++;
+		bitmap_set_multiple (fat_fs->dirty_map, sec, cnt, false);
+
+		// Whole sectors in one transfer, then a partial last sector
+		size_t full = sec + cnt <= full_sectors ? cnt
+		              : sec < full_sectors ? full_sectors - sec : 0;
+		if (full > 0)
+			disk_write_multiple (filesys_disk, fat_fs->bs.fat_start + sec,
+			                     buffer + sec * DISK_SECTOR_SIZE, full);
+		if (full < cnt) {
+			uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
 			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
+				PANIC ("FAT sync failed");
+			memcpy (bounce, buffer + full_sectors * DISK_SECTOR_SIZE,
+			        fat_size_in_bytes % DISK_SECTOR_SIZE);
+			disk_write (filesys_disk,
+			            fat_fs->bs.fat_start + full_sectors, bounce);
 			free (bounce);
 		}
 	}
+	lock_release (&fat_fs->write_lock);
 }
 
 void
@@ -126,6 +157,10 @@ fat_create (void) {
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
+	fat_maps_init ();
+
+	// Nothing of the old FAT on disk is valid
+	bitmap_set_all (fat_fs->dirty_map, true);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
@@ -152,7 +187,36 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	unsigned int data_sectors;
+
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length =
+	    fat_fs->bs.fat_sectors * DISK_SECTOR_SIZE / sizeof (cluster_t);
+	data_sectors = fat_fs->bs.total_sectors - fat_fs->data_start;
+	if (fat_fs->fat_length > data_sectors / SECTORS_PER_CLUSTER + 1)
+		fat_fs->fat_length = data_sectors / SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Builds the map of used clusters from the FAT, and an empty map of
+ * changed FAT sectors.  Cluster 0 is never handed out, so it is marked
+ * used. */
+static void
+fat_maps_init (void) {
+	cluster_t clst;
+
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty_map == NULL)
+		PANIC ("FAT dirty map creation failed");
+
+	fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->used_map == NULL)
+		PANIC ("FAT used map creation failed");
+	bitmap_mark (fat_fs->used_map, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_map, clst);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -164,30 +228,120 @@ fat_fs_init (void) {
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	return fat_create_chain_multiple (clst, 1);
+}
+
+/* Adds CNT clusters to the end of the chain that ends at CLST, or
+ * starts a new chain of CNT clusters if CLST is 0.  The clusters are
+ * made as contiguous as free space allows, starting right after CLST
+ * if possible.
+ * Returns the first new cluster, or 0 if the disk has fewer than CNT
+ * free clusters, in which case the chain is left unchanged. */
+cluster_t
+fat_create_chain_multiple (cluster_t clst, size_t cnt) {
+	cluster_t first = 0;
+	cluster_t prev = clst;
+
+	ASSERT (cnt > 0);
+	lock_acquire (&fat_fs->write_lock);
+	while (cnt > 0) {
+		size_t run = cnt;
+		cluster_t start = fat_allocate (prev != 0 ? prev + 1 : 0, &run);
+		cluster_t i;
+
+		if (start == 0) {
+			/* Out of space.  Undo. */
+			lock_release (&fat_fs->write_lock);
+			if (first != 0)
+				fat_remove_chain (first, clst);
+			return 0;
+		}
+		for (i = start; i < start + run; i++) {
+			if (prev != 0)
+				fat_put (prev, i);
+			prev = i;
+		}
+		fat_put (prev, EOChain);
+		if (first == 0)
+			first = start;
+		cnt -= run;
+	}
+	lock_release (&fat_fs->write_lock);
+	return first;
+}
+
+/* Marks a run of free clusters used and returns its first cluster.
+ * Tries the *CNT clusters starting at NEAR first, if NEAR is nonzero,
+ * and otherwise searches for the first free run of *CNT clusters at
+ * or after the next-fit cursor, wrapping around.  If there is no such
+ * run, settles for a shorter one and updates *CNT.
+ * Returns 0 if no cluster is free.  The write lock must be held. */
+static cluster_t
+fat_allocate (cluster_t near, size_t *cnt) {
+	struct bitmap *map = fat_fs->used_map;
+	size_t want = *cnt;
+	size_t start;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+	if (near != 0 && near + want <= fat_fs->fat_length
+	    && bitmap_none (map, near, want))
+		start = near;
+	else
+		for (;;) {
+			start = bitmap_scan (map, fat_fs->last_clst, want, false);
+			if (start == BITMAP_ERROR)
+				start = bitmap_scan (map, 0, want, false);
+			if (start != BITMAP_ERROR)
+				break;
+			if (want == 1)
+				return 0;
+			want /= 2;
+		}
+
+	bitmap_set_multiple (map, start, want, true);
+	fat_fs->last_clst = start + want;
+	if (fat_fs->last_clst >= fat_fs->fat_length)
+		fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	*cnt = want;
+	return start;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+		fat_put (clst, 0);
+		bitmap_reset (fat_fs->used_map, clst);
+		clst = next;
+	}
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
+	if (fat_fs->dirty_map != NULL)
+		bitmap_mark (fat_fs->dirty_map,
+		             clst * sizeof (cluster_t) / DISK_SECTOR_SIZE);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
 }
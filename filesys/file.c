@@ -3,14 +3,24 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window bounds, in bytes.  The window starts at
+ * RA_MIN once reads look sequential and doubles on each further
+ * sequential read, up to RA_MAX. */
+#define RA_MIN (4 * DISK_SECTOR_SIZE)
+#define RA_MAX (32 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file
 {
 	struct inode *inode; /* File's inode. */
 	off_t pos;			 /* Current position. */
 	bool deny_write;	 /* Has file_deny_write() been called? */
+	off_t ra_next;		 /* Offset a sequential read would start at. */
+	off_t ra_window;	 /* Bytes to read ahead, 0 if not sequential. */
 };
 
+static void file_readahead(struct file *, off_t size, off_t file_ofs);
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
@@ -23,6 +33,8 @@ file_open(struct inode *inode)
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ra_next = 0;
+		file->ra_window = 0;
 		return file;
 	}
 	else
@@ -81,7 +93,10 @@ file_get_inode(struct file *file)
  * Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file *file, void *buffer, off_t size)
 {
-	off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+	off_t bytes_read;
+
+	file_readahead(file, size, file->pos);
+	bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -93,15 +108,40 @@ off_t file_read(struct file *file, void *buffer, off_t size)
  * The file's current position is unaffected. */
 off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
 {
+	file_readahead(file, size, file_ofs);
 	return inode_read_at(file->inode, buffer, size, file_ofs);
 }
 
+/* Prepares for reading SIZE bytes of FILE at offset FILE_OFS.
+ * Starts fetching all of the requested sectors at once, so that
+ * the disk can transfer them in one go, and, if FILE has been
+ * read sequentially, also the read-ahead window that follows. */
+static void
+file_readahead(struct file *file, off_t size, off_t file_ofs)
+{
+	if (file_ofs == file->ra_next && file_ofs != 0)
+	{
+		file->ra_window *= 2;
+		if (file->ra_window < RA_MIN)
+			file->ra_window = RA_MIN;
+		else if (file->ra_window > RA_MAX)
+			file->ra_window = RA_MAX;
+	}
+	else
+		file->ra_window = 0;
+	file->ra_next = file_ofs + size;
+
+	if (size > DISK_SECTOR_SIZE)
+		inode_prefetch(file->inode, file_ofs, size, false);
+	if (file->ra_window > 0)
+		inode_prefetch(file->inode, file_ofs + size, file->ra_window, true);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file *file, const void *buffer, off_t size)
 {
@@ -113,9 +153,8 @@ off_t file_write(struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t file_write_at(struct file *file, const void *buffer, off_t size,
 					off_t file_ofs)
@@ -1,19 +1,33 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Number of disk sectors mapped by one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct bitmap *dirty_map;     /* Free map file sectors not written. */
+static struct lock free_map_lock;    /* Protects the maps. */
+
+static void mark_dirty (disk_sector_t, size_t cnt);
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	lock_init (&free_map_lock);
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+				DISK_SECTOR_SIZE));
+	if (dirty_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -24,24 +38,84 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
-	if (sector != BITMAP_ERROR)
+	disk_sector_t sector;
+
+	lock_acquire (&free_map_lock);
+	sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	if (sector != BITMAP_ERROR) {
+		mark_dirty (sector, cnt);
 		*sectorp = sector;
+	}
+	lock_release (&free_map_lock);
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates the CNT consecutive sectors starting at SECTOR, if
+ * they are all free.
+ * Returns true if successful, false if any of them was in use or
+ * past the end of the disk. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	bool success = false;
+
+	lock_acquire (&free_map_lock);
+	if (sector + cnt <= bitmap_size (free_map)
+			&& bitmap_none (free_map, sector, cnt)) {
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		mark_dirty (sector, cnt);
+		success = true;
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	mark_dirty (sector, cnt);
+	lock_release (&free_map_lock);
+}
+
+/* Records that the free map file sectors holding the bits for the
+ * CNT sectors starting at SECTOR must be written. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+	ASSERT (cnt > 0);
+	bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Writes the changed parts of the free map to the free map file.
+ * Allocations and releases only update the map in memory, so this
+ * runs at sync points: periodically from the sector cache flusher
+ * and when the free map is closed. */
+void
+free_map_sync (void) {
+	size_t i;
+
+	if (free_map == NULL)
+		return;
+	lock_acquire (&free_map_lock);
+	for (i = 0; free_map_file != NULL && i < bitmap_size (dirty_map); i++) {
+		size_t n;
+
+		if (!bitmap_test (dirty_map, i))
+			continue;
+		for (n = 1; i + n < bitmap_size (dirty_map)
+				&& bitmap_test (dirty_map, i + n); n++)
+			continue;
+		if (!bitmap_write_partial (free_map, free_map_file,
+					i * DISK_SECTOR_SIZE, n * DISK_SECTOR_SIZE))
+			PANIC ("can't write free map");
+		bitmap_set_multiple (dirty_map, i, n, false);
+		i += n - 1;
+	}
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,7 +131,11 @@ free_map_open (void) {
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_sync ();
+	lock_acquire (&free_map_lock);
 	file_close (free_map_file);
+	free_map_file = NULL;
+	lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -74,4 +152,5 @@ free_map_create (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_map, false);
 }
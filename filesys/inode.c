@@ -1,22 +1,43 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of consecutive data sectors. */
+struct extent {
+	disk_sector_t start;                /* First sector. */
+	uint32_t count;                     /* Number of sectors. */
+};
+
+/* Number of extents stored in the inode itself, in the indirect
+ * extent block, and in total. */
+#define DIRECT_EXTENTS 62
+#define INDIRECT_EXTENTS (DISK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (DIRECT_EXTENTS + INDIRECT_EXTENTS)
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ *
+ * The file's data is the concatenation of its extents, the first
+ * DIRECT_EXTENTS of which are stored here and the rest in the
+ * indirect extent block.  The extents may hold more sectors than
+ * LENGTH needs, if growing the file failed part way. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents in use. */
+	disk_sector_t indirect;             /* Indirect extent block, or 0. */
+	struct extent extents[DIRECT_EXTENTS]; /* Direct extents. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,37 +47,195 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* Extents an inode may have before byte_to_sector() looks them up
+ * in an index instead of walking them. */
+#define INDEX_MIN_EXTENTS 8
+
+/* Index of the extents of an open inode, for byte_to_sector(). */
+struct extent_index {
+	struct extent_index *prev;          /* Index this one replaced. */
+	size_t cap;                         /* Number of elements of ENDS. */
+	size_t cnt;                         /* Number in use. */
+	uint32_t ends[];                    /* ENDS[I]: sectors in extents
+	                                       0 through I. */
+};
+
+/* In-memory inode.
+ * The members inode_open() looks at come first, and the on-disk
+ * inode is allocated separately, so that the hash table of open
+ * inodes is searched without touching a sector's worth of data
+ * per inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-	struct inode_disk data;             /* Inode content. */
+	struct inode_disk *data;            /* Inode content. */
+	struct extent *indirect;            /* Indirect extents, or null. */
+	struct extent_index *index;         /* Extent index, or null. */
+	struct lock grow_lock;              /* Serializes writes past EOF. */
 };
 
+static bool add_sectors (struct inode_disk *, struct extent **, size_t cnt);
+static void release_sectors (struct inode_disk *, struct extent *);
+static void write_inode (disk_sector_t, const struct inode_disk *,
+		const struct extent *);
+
+/* Returns extent IDX of the inode DISK, whose indirect extents are
+ * INDIRECT. */
+static struct extent *
+get_extent (struct inode_disk *disk, struct extent *indirect, size_t idx) {
+	ASSERT (idx < MAX_EXTENTS);
+	if (idx < DIRECT_EXTENTS)
+		return &disk->extents[idx];
+	ASSERT (indirect != NULL);
+	return &indirect[idx - DIRECT_EXTENTS];
+}
+
+/* Returns the number of data sectors allocated to the inode DISK,
+ * whose indirect extents are INDIRECT. */
+static size_t
+allocated_sectors (struct inode_disk *disk, struct extent *indirect) {
+	size_t cnt = 0;
+	size_t i;
+
+	for (i = 0; i < disk->extent_cnt; i++)
+		cnt += get_extent (disk, indirect, i)->count;
+	return cnt;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	struct extent_index *index;
+	size_t idx = pos / DISK_SECTOR_SIZE;
+	size_t i = 0;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
-		return -1;
+	index = inode->index;
+
+	/* Skip, by binary search, the indexed extents that end at or
+	 * before IDX. */
+	if (index != NULL) {
+		size_t lo = 0, hi = index->cnt;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (idx < index->ends[mid])
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (lo > 0)
+			idx -= index->ends[lo - 1];
+		i = lo;
+	}
+
+	for (; i < inode->data->extent_cnt; i++) {
+		struct extent *e = get_extent (inode->data, inode->indirect, i);
+		if (idx < e->count)
+			return e->start + idx;
+		idx -= e->count;
+	}
+	return -1;
+}
+
+/* Brings INODE's extent index up to date after extents FROM and
+ * later were added or grew.  An inode with only a few extents has
+ * no index; byte_to_sector() walks them.  The index is replaced by a
+ * bigger one when it fills up, but since readers do not lock the
+ * inode, the old one is kept until the inode is freed.  The new
+ * entries are stored before they are counted, or the new index
+ * before it is published, so that byte_to_sector() never sees an
+ * entry that is not filled in yet.  Call with GROW_LOCK held, or
+ * before INODE is visible to other threads. */
+static void
+index_extents (struct inode *inode, size_t from) {
+	struct extent_index *index = inode->index;
+	size_t cnt = inode->data->extent_cnt;
+	uint32_t end;
+	size_t i;
+
+	if (cnt <= INDEX_MIN_EXTENTS)
+		return;
+	if (index == NULL || index->cap < cnt) {
+		size_t cap = index != NULL ? index->cap : INDEX_MIN_EXTENTS;
+		struct extent_index *new;
+
+		while (cap < cnt)
+			cap *= 2;
+		new = malloc (sizeof *new + cap * sizeof *new->ends);
+		if (new == NULL)
+			/* byte_to_sector() walks the extents the index lacks. */
+			return;
+		new->prev = index;
+		new->cap = cap;
+		new->cnt = 0;
+		index = new;
+		from = 0;
+	}
+
+	end = from > 0 ? index->ends[from - 1] : 0;
+	for (i = from; i < cnt; i++) {
+		end += get_extent (inode->data, inode->indirect, i)->count;
+		index->ends[i] = end;
+	}
+	barrier ();
+	index->cnt = cnt;
+	barrier ();
+	inode->index = index;
+}
+
+/* Frees INODE's extent index and the ones it replaced. */
+static void
+free_index (struct inode *inode) {
+	struct extent_index *index = inode->index;
+
+	while (index != NULL) {
+		struct extent_index *prev = index->prev;
+		free (index);
+		index = prev;
+	}
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, keyed by sector, so that opening a single inode
+ * twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and the open_cnt of each open inode. */
+static struct lock open_inodes_lock;
+
+/* Number of times an inode has left open_inodes.  Protected by
+ * open_inodes_lock. */
+static unsigned close_gen;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&open_inodes, inode_hash, inode_less, NULL);
+	lock_init (&open_inodes_lock);
+}
+
+/* Returns a hash value for open inode E. */
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct inode *inode = hash_entry (e, struct inode, elem);
+	return hash_int (inode->sector);
+}
+
+/* Returns true if open inode A's sector precedes B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -67,6 +246,7 @@ inode_init (void) {
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
+	struct extent *indirect = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
@@ -77,63 +257,207 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		if (add_sectors (disk_inode, &indirect, bytes_to_sectors (length))) {
+			write_inode (sector, disk_inode, indirect);
+			success = true;
+		} else
+			release_sectors (disk_inode, indirect);
+		free (indirect);
 		free (disk_inode);
 	}
 	return success;
 }
 
-/* Reads an inode from SECTOR
- * and returns a `struct inode' that contains it.
- * Returns a null pointer if memory allocation fails. */
-struct inode *
-inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
+/* Appends CNT zeroed sectors to the data of the inode DISK, whose
+ * indirect extents are *INDIRECT.  Grows the last extent in place
+ * when the sectors after it are free, and otherwise adds extents
+ * as long as the free map allows, allocating the indirect extent
+ * block into *INDIRECT when the direct extents run out.
+ * Returns true if successful, false if the disk is full or the
+ * inode has no room for another extent; in that case, the sectors
+ * added so far are kept in DISK. */
+static bool
+add_sectors (struct inode_disk *disk, struct extent **indirect, size_t cnt) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t n = cnt;
+
+	while (cnt > 0) {
+		struct extent *last = NULL;
+		disk_sector_t start;
+		size_t i;
+
+		if (n > cnt)
+			n = cnt;
+		if (disk->extent_cnt > 0)
+			last = get_extent (disk, *indirect, disk->extent_cnt - 1);
+
+		if (last != NULL
+				&& free_map_allocate_at (last->start + last->count, n)) {
+			start = last->start + last->count;
+			last->count += n;
+		} else if (disk->extent_cnt < MAX_EXTENTS
+				&& free_map_allocate (n, &start)) {
+			if (disk->extent_cnt == DIRECT_EXTENTS) {
+				ASSERT (*indirect == NULL);
+				*indirect = calloc (INDIRECT_EXTENTS, sizeof **indirect);
+				if (*indirect == NULL
+						|| !free_map_allocate (1, &disk->indirect)) {
+					free (*indirect);
+					*indirect = NULL;
+					free_map_release (start, n);
+					return false;
+				}
+			}
+			last = get_extent (disk, *indirect, disk->extent_cnt++);
+			last->start = start;
+			last->count = n;
+		} else if (n > 1) {
+			/* No run of N free sectors.  Settle for a shorter one. */
+			n /= 2;
+			continue;
+		} else
+			return false;
+
+		for (i = 0; i < n; i++)
+			page_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		cnt -= n;
+	}
+	return true;
+}
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+/* Releases the data sectors and indirect extent block of the inode
+ * DISK, whose indirect extents are INDIRECT. */
+static void
+release_sectors (struct inode_disk *disk, struct extent *indirect) {
+	size_t i;
+
+	for (i = 0; i < disk->extent_cnt; i++) {
+		struct extent *e = get_extent (disk, indirect, i);
+		free_map_release (e->start, e->count);
 	}
+	if (disk->indirect != 0)
+		free_map_release (disk->indirect, 1);
+}
+
+/* Writes the inode DISK, whose indirect extents are INDIRECT, to
+ * SECTOR and to its indirect extent block. */
+static void
+write_inode (disk_sector_t sector, const struct inode_disk *disk,
+		const struct extent *indirect) {
+	page_cache_write (sector, disk, 0, DISK_SECTOR_SIZE);
+	if (disk->indirect != 0)
+		page_cache_write (disk->indirect, indirect, 0, DISK_SECTOR_SIZE);
+}
+
+/* Allocates an in-memory inode and reads the inode at SECTOR into
+ * it, without looking at open_inodes.
+ * Returns a null pointer if memory allocation fails. */
+static struct inode *
+read_inode (disk_sector_t sector) {
+	struct inode *inode;
 
-	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
 	if (inode == NULL)
 		return NULL;
+	inode->data = malloc (sizeof *inode->data);
+	inode->indirect = NULL;
+	inode->index = NULL;
+	if (inode->data == NULL)
+		goto fail;
+	page_cache_read (sector, inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->data->indirect != 0) {
+		inode->indirect = malloc (DISK_SECTOR_SIZE);
+		if (inode->indirect == NULL)
+			goto fail;
+		page_cache_read (inode->data->indirect, inode->indirect, 0,
+				DISK_SECTOR_SIZE);
+	}
+	index_extents (inode, 0);
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	lock_init (&inode->grow_lock);
 	return inode;
+
+fail:
+	free (inode->data);
+	free (inode);
+	return NULL;
+}
+
+/* Frees the memory of INODE, which is not in open_inodes. */
+static void
+discard_inode (struct inode *inode) {
+	free_index (inode);
+	free (inode->indirect);
+	free (inode->data);
+	free (inode);
+}
+
+/* Reads an inode from SECTOR
+ * and returns a `struct inode' that contains it.
+ * Returns a null pointer if memory allocation fails.
+ *
+ * The inode is read without holding open_inodes_lock, so that
+ * opening one inode does not wait on the disk for another.  Then
+ * open_inodes is searched again: if someone else opened the inode
+ * meanwhile, theirs is used, and if an inode was closed meanwhile,
+ * what was read may predate its last writes, so it is read again. */
+struct inode *
+inode_open (disk_sector_t sector) {
+	struct inode key, *inode;
+	struct hash_elem *e;
+	unsigned gen;
+
+	key.sector = sector;
+	for (;;) {
+		/* Check whether this inode is already open. */
+		lock_acquire (&open_inodes_lock);
+		e = hash_find (&open_inodes, &key.elem);
+		if (e != NULL) {
+			inode = hash_entry (e, struct inode, elem);
+			inode->open_cnt++;
+			lock_release (&open_inodes_lock);
+			return inode;
+		}
+		gen = close_gen;
+		lock_release (&open_inodes_lock);
+
+		inode = read_inode (sector);
+		if (inode == NULL)
+			return NULL;
+
+		lock_acquire (&open_inodes_lock);
+		e = hash_find (&open_inodes, &key.elem);
+		if (e == NULL && gen == close_gen) {
+			hash_insert (&open_inodes, &inode->elem);
+			lock_release (&open_inodes_lock);
+			return inode;
+		}
+		if (e != NULL) {
+			struct inode *open = hash_entry (e, struct inode, elem);
+			open->open_cnt++;
+			lock_release (&open_inodes_lock);
+			discard_inode (inode);
+			return open;
+		}
+		lock_release (&open_inodes_lock);
+		discard_inode (inode);
+	}
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -153,19 +477,24 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
-		}
+	lock_acquire (&open_inodes_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&open_inodes_lock);
+		return;
+	}
+
+	/* Remove from inode table and release lock. */
+	hash_delete (&open_inodes, &inode->elem);
+	close_gen++;
+	lock_release (&open_inodes_lock);
 
-		free (inode); 
+	/* Deallocate blocks if removed. */
+	if (inode->removed) {
+		free_map_release (inode->sector, 1);
+		release_sectors (inode->data, inode->indirect);
 	}
+
+	discard_inode (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -183,7 +512,7 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+	uint8_t bounce[DISK_SECTOR_SIZE];
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,53 +529,92 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Touching a user buffer may fault and evict a page to this
+		 * very sector, so it is not done while the cache holds the
+		 * sector. */
+		if (is_user_vaddr (buffer)) {
+			page_cache_read (sector_idx, bounce, sector_ofs, chunk_size);
+			memcpy (buffer + bytes_read, bounce, chunk_size);
+		} else
+			page_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Starts reading the sectors that hold the SIZE bytes of INODE
+ * starting at OFFSET into the sector cache, without waiting for
+ * them.  READAHEAD is true if the data is only expected to be
+ * read soon, false if the caller is about to read it.  Bytes past
+ * end of file are ignored. */
+void
+inode_prefetch (struct inode *inode, off_t offset, off_t size,
+		bool readahead) {
+	off_t length = inode_length (inode);
+
+	if (offset >= length || size <= 0)
+		return;
+	if (size > length - offset)
+		size = length - offset;
+
+	size += offset % DISK_SECTOR_SIZE;
+	offset -= offset % DISK_SECTOR_SIZE;
+	for (; size > 0; offset += DISK_SECTOR_SIZE, size -= DISK_SECTOR_SIZE)
+		page_cache_prefetch (byte_to_sector (inode, offset), readahead);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode, filling any gap
+ * with zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
+	uint8_t bounce[DISK_SECTOR_SIZE];
+	off_t length;
+	bool grow;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	/* Extending writes are serialized, and the new length is only
+	 * published once the data is in place, so that readers never
+	 * see the zeros of a half-finished write. */
+	length = inode_length (inode);
+	grow = size > 0 && offset + size > length;
+	if (grow) {
+		size_t have, need;
+
+		lock_acquire (&inode->grow_lock);
+		have = allocated_sectors (inode->data, inode->indirect);
+		need = bytes_to_sectors (offset + size);
+		if (need > have) {
+			size_t cnt = inode->data->extent_cnt;
+			add_sectors (inode->data, &inode->indirect, need - have);
+			index_extents (inode, cnt > 0 ? cnt - 1 : 0);
+		}
+		length = allocated_sectors (inode->data, inode->indirect)
+			* DISK_SECTOR_SIZE;
+		if (length > offset + size)
+			length = offset + size;
+	}
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = length - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -255,35 +623,27 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* See inode_read_at(). */
+		if (is_user_vaddr (buffer)) {
+			memcpy (bounce, buffer + bytes_written, chunk_size);
+			page_cache_write (sector_idx, bounce, sector_ofs, chunk_size);
+		} else
+			page_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
+	if (grow) {
+		if (offset > inode->data->length) {
+			inode->data->length = offset;
+			write_inode (inode->sector, inode->data, inode->indirect);
+		}
+		lock_release (&inode->grow_lock);
+	}
 	return bytes_written;
 }
 
@@ -309,5 +669,5 @@ inode_allow_write (struct inode *inode) {
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
-	return inode->data.length;
+	return inode->data->length;
 }
@@ -1,6 +1,17 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
 #include "vm/vm.h"
+#include "filesys/page_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/fat.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -15,6 +26,89 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* Sector cache.
+
+   The file system reads and writes disk sectors through a cache
+   of CACHE_SIZE sectors, indexed by sector number in a hash table
+   and evicted by the clock algorithm.  Writes only dirty the
+   cached copy.  A write-behind daemon writes back sectors that
+   have been dirty for FLUSH_AGE ticks, and everything is written
+   back by page_cache_flush() when the file system shuts down.
+   The daemon also writes out the changed parts of the free map
+   (or FAT) on each pass, so that allocations reach the disk on
+   the same schedule as the data written into them.
+
+   page_cache_prefetch() starts reading sectors into the cache
+   without waiting for them, so that the disk daemon can merge
+   consecutive sectors into one command and the caller can go on
+   working meanwhile.  Such an entry is pinned and marked loading
+   until the read completes; threads that look it up wait on its
+   loaded condition.
+
+   CACHE_LOCK protects the hash table, the clock hand, and each
+   entry's sector, valid, accessed and pin_cnt members.  Each
+   entry's own lock protects its data and dirty state, and is held
+   while the entry is read from or written to disk.  An entry with
+   a nonzero pin_cnt is in use and is never evicted, so its sector
+   cannot change under a thread waiting for its lock. */
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+/* Ticks between runs of the write-behind daemon, and ticks a
+   sector may stay dirty before the daemon writes it back. */
+#define FLUSH_INTERVAL TIMER_FREQ
+#define FLUSH_AGE (TIMER_FREQ * 5)
+
+/* How a cache entry was brought in, until it is first used. */
+enum cache_fetch {
+	FETCH_USED,                     /* Already used, or loaded on demand. */
+	FETCH_BATCH,                    /* Prefetched for an imminent read. */
+	FETCH_AHEAD                     /* Prefetched by read-ahead. */
+};
+
+/* A cached sector. */
+struct cache_entry {
+	struct hash_elem elem;          /* Element in cache_map. */
+	disk_sector_t sector;           /* Cached sector, if valid. */
+	bool valid;                     /* True if in cache_map. */
+	bool accessed;                  /* Used since the clock hand passed. */
+	int pin_cnt;                    /* Number of threads using it. */
+
+	enum cache_fetch fetch;         /* How it was loaded, until first use. */
+
+	struct lock lock;               /* Protects data and dirty state. */
+	bool loading;                   /* True while being prefetched. */
+	struct condition loaded;        /* Signaled when loading ends. */
+	bool dirty;                     /* True if data differs from disk. */
+	int64_t dirty_since;            /* Tick at which data became dirty. */
+	struct disk_request request;    /* Prefetch request. */
+	uint8_t data[DISK_SECTOR_SIZE]; /* Sector contents. */
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct hash cache_map;
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Statistics. */
+static long long cache_hits;
+static long long cache_misses;
+static long long cache_writebacks;
+static long long readahead_sectors;
+static long long readahead_hits;
+static long long readahead_unused;
+
+static struct cache_entry *cache_get (disk_sector_t, bool load);
+static struct cache_entry *clock_victim (void);
+static void cache_install (struct cache_entry *, disk_sector_t,
+		enum cache_fetch);
+static void prefetch_done (struct disk_request *);
+static void cache_put (struct cache_entry *);
+static void cache_write_back (struct cache_entry *, int64_t older_than);
+static void write_back_pinned (struct cache_entry *, int64_t older_than);
+static void page_cache_kworkerd (void *aux);
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
@@ -44,7 +138,312 @@ static void
 page_cache_destroy (struct page *page) {
 }
 
-/* Worker thread for page cache */
+/* Worker thread for page cache: the write-behind daemon.  Wakes
+   up every FLUSH_INTERVAL ticks, writes out the changed parts of
+   the allocation maps, and writes back the sectors that have been
+   dirty for at least FLUSH_AGE ticks. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		size_t i;
+
+		timer_sleep (FLUSH_INTERVAL);
+#ifdef EFILESYS
+		fat_sync ();
+#endif
+		free_map_sync ();
+		for (i = 0; i < CACHE_SIZE; i++)
+			cache_write_back (&cache[i], timer_ticks () - FLUSH_AGE);
+	}
+}
+
+/* Returns a hash value for cache entry E. */
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_entry *c = hash_entry (e, struct cache_entry, elem);
+	return hash_int (c->sector);
+}
+
+/* Returns true if cache entry A's sector precedes B's. */
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_entry, elem)->sector
+		< hash_entry (b, struct cache_entry, elem)->sector;
+}
+
+/* Initializes the sector cache and starts its write-behind
+   daemon. */
+void
+page_cache_init (void) {
+	size_t i;
+
+	if (!hash_init (&cache_map, cache_hash, cache_less, NULL))
+		PANIC ("sector cache initialization failed");
+	lock_init (&cache_lock);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		cache[i].valid = false;
+		cache[i].pin_cnt = 0;
+		cache[i].fetch = FETCH_USED;
+		cache[i].loading = false;
+		cache[i].dirty = false;
+		lock_init (&cache[i].lock);
+		cond_init (&cache[i].loaded);
+	}
+	clock_hand = 0;
+
+	page_cache_workerd = thread_create ("flushd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("can't start write-behind daemon");
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR of
+   the file system disk into BUFFER, through the cache. */
+void
+page_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *c;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	c = cache_get (sector, true);
+	memcpy (buffer, c->data + ofs, size);
+	cache_put (c);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte offset OFS within
+   SECTOR of the file system disk, through the cache.  The write
+   reaches the disk later. */
+void
+page_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	struct cache_entry *c;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	/* A write of a whole sector need not read it first. */
+	c = cache_get (sector, size < DISK_SECTOR_SIZE);
+	memcpy (c->data + ofs, buffer, size);
+	if (!c->dirty) {
+		c->dirty = true;
+		c->dirty_since = timer_ticks ();
+	}
+	cache_put (c);
+}
+
+/* Starts reading SECTOR of the file system disk into the cache
+   and returns without waiting for it.  READAHEAD is true if the
+   sector is only expected to be needed, false if the caller is
+   about to read it.  Does nothing if SECTOR is already cached, or
+   if making room for it would mean waiting for a dirty sector to
+   be written back. */
+void
+page_cache_prefetch (disk_sector_t sector, bool readahead) {
+	struct cache_entry key, *c;
+
+	key.sector = sector;
+	lock_acquire (&cache_lock);
+	if (hash_find (&cache_map, &key.elem) != NULL) {
+		lock_release (&cache_lock);
+		return;
+	}
+	c = clock_victim ();
+	if (c == NULL || (c->valid && c->dirty)) {
+		lock_release (&cache_lock);
+		return;
+	}
+	cache_install (c, sector, readahead ? FETCH_AHEAD : FETCH_BATCH);
+	c->loading = true;
+	lock_release (&cache_lock);
+
+	disk_request_init (&c->request, filesys_disk, sector, c->data, 1, false,
+			prefetch_done, c);
+	disk_submit (&c->request);
+}
+
+/* Completion function for a prefetch of the cache entry that is
+   R's auxiliary data.  Runs in the disk daemon. */
+static void
+prefetch_done (struct disk_request *r) {
+	struct cache_entry *c = r->aux;
+
+	lock_acquire (&c->lock);
+	c->loading = false;
+	cond_broadcast (&c->loaded, &c->lock);
+	lock_release (&c->lock);
+
+	lock_acquire (&cache_lock);
+	c->pin_cnt--;
+	lock_release (&cache_lock);
+}
+
+/* Writes every dirty cached sector back to disk. */
+void
+page_cache_flush (void) {
+	size_t i;
+
+	for (i = 0; i < CACHE_SIZE; i++)
+		cache_write_back (&cache[i], INT64_MAX);
+}
+
+/* Prints sector cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Sector cache: %lld hits, %lld misses, %lld writebacks\n",
+			cache_hits, cache_misses, cache_writebacks);
+	printf ("Read-ahead: %lld sectors, %lld hits, %lld unused\n",
+			readahead_sectors, readahead_hits, readahead_unused);
+}
+
+/* Returns the cache entry for SECTOR, with its lock held and
+   pinned so that it stays in the cache until cache_put().  On a
+   miss, evicts an entry and, if LOAD is true, reads SECTOR into
+   it; otherwise the caller must overwrite the whole sector. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool load) {
+	struct cache_entry key, *c;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	for (;;) {
+		lock_acquire (&cache_lock);
+		e = hash_find (&cache_map, &key.elem);
+		if (e != NULL) {
+			c = hash_entry (e, struct cache_entry, elem);
+			c->pin_cnt++;
+			c->accessed = true;
+			if (c->fetch != FETCH_BATCH)
+				cache_hits++;
+			if (c->fetch == FETCH_AHEAD)
+				readahead_hits++;
+			c->fetch = FETCH_USED;
+			lock_release (&cache_lock);
+
+			lock_acquire (&c->lock);
+			while (c->loading)
+				cond_wait (&c->loaded, &c->lock);
+			return c;
+		}
+
+		c = clock_victim ();
+		if (c == NULL) {
+			/* Every entry is in use.  Let their users finish. */
+			lock_release (&cache_lock);
+			thread_yield ();
+			continue;
+		}
+
+		/* A dirty victim must be written back before its sector
+		   leaves the hash table, or a reader could fetch stale data
+		   from disk.  Write it back and look again. */
+		if (c->valid && c->dirty) {
+			c->pin_cnt++;
+			lock_release (&cache_lock);
+			write_back_pinned (c, INT64_MAX);
+			continue;
+		}
+
+		cache_install (c, sector, FETCH_USED);
+
+		/* Unpinned entries are unlocked, so this does not block; other
+		   threads looking up SECTOR wait on the lock until the data
+		   is in. */
+		lock_acquire (&c->lock);
+		lock_release (&cache_lock);
+		if (load)
+			disk_read (filesys_disk, sector, c->data);
+		return c;
+	}
+}
+
+/* Sweeps the clock hand over the unpinned cache entries, clearing
+   accessed bits, until it finds one that was not accessed since
+   the last sweep, and returns it.  Returns a null pointer if every
+   entry is pinned.  CACHE_LOCK must be held. */
+static struct cache_entry *
+clock_victim (void) {
+	size_t sweeps;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	for (sweeps = 0; sweeps < 2 * CACHE_SIZE; sweeps++) {
+		struct cache_entry *c = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % CACHE_SIZE;
+		if (c->pin_cnt > 0)
+			continue;
+		if (c->valid && c->accessed)
+			c->accessed = false;
+		else
+			return c;
+	}
+	return NULL;
+}
+
+/* Reuses unpinned, clean cache entry C for SECTOR, which is not
+   cached, and pins it.  FETCH says how the caller will load it.
+   CACHE_LOCK must be held. */
+static void
+cache_install (struct cache_entry *c, disk_sector_t sector,
+		enum cache_fetch fetch) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (c->pin_cnt == 0 && !c->dirty);
+
+	if (c->valid) {
+		hash_delete (&cache_map, &c->elem);
+		if (c->fetch == FETCH_AHEAD)
+			readahead_unused++;
+	}
+	c->sector = sector;
+	c->valid = true;
+	c->accessed = true;
+	c->fetch = fetch;
+	c->pin_cnt++;
+	hash_insert (&cache_map, &c->elem);
+	if (fetch == FETCH_AHEAD)
+		readahead_sectors++;
+	else
+		cache_misses++;
+}
+
+/* Releases cache entry C, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *c) {
+	lock_release (&c->lock);
+	lock_acquire (&cache_lock);
+	c->pin_cnt--;
+	lock_release (&cache_lock);
+}
+
+/* Writes cache entry C back to disk if it is dirty and became
+   dirty no later than tick OLDER_THAN. */
+static void
+cache_write_back (struct cache_entry *c, int64_t older_than) {
+	lock_acquire (&cache_lock);
+	if (!c->valid) {
+		lock_release (&cache_lock);
+		return;
+	}
+	c->pin_cnt++;
+	lock_release (&cache_lock);
+	write_back_pinned (c, older_than);
+}
+
+/* Does the work of cache_write_back() for C, which the caller has
+   pinned, and unpins it. */
+static void
+write_back_pinned (struct cache_entry *c, int64_t older_than) {
+	bool written = false;
+
+	lock_acquire (&c->lock);
+	if (c->dirty && c->dirty_since <= older_than) {
+		disk_write (filesys_disk, c->sector, c->data);
+		c->dirty = false;
+		written = true;
+	}
+	lock_release (&c->lock);
+
+	lock_acquire (&cache_lock);
+	c->pin_cnt--;
+	if (written)
+		cache_writebacks++;
+	lock_release (&cache_lock);
 }
@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,6 +18,27 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Maximum number of sectors in one request. */
+#define DISK_REQUEST_MAX 256
+
+struct disk_request;
+typedef void disk_request_func (struct disk_request *);
+
+/* An asynchronous disk request.  See disk_submit(). */
+struct disk_request {
+	struct list_elem elem;          /* Element in channel's queue. */
+	struct list_elem fifo_elem;     /* Element in channel's fifo. */
+	struct disk *disk;              /* Disk to transfer to or from. */
+	disk_sector_t sec_no;           /* First sector. */
+	void *buffer;                   /* Kernel buffer. */
+	size_t cnt;                     /* Number of sectors. */
+	bool write;                     /* True to write, false to read. */
+	disk_request_func *done;        /* Called when complete. */
+	void *aux;                      /* For use by DONE. */
+	int64_t deadline;               /* Timer tick to serve it by. */
+	uint64_t start;                 /* TSC at submission. */
+};
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +46,13 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, void *, size_t cnt);
+void disk_write_multiple (struct disk *, disk_sector_t, const void *,
+		size_t cnt);
+
+void disk_request_init (struct disk_request *, struct disk *, disk_sector_t,
+		void *buffer, size_t cnt, bool write, disk_request_func *, void *aux);
+void disk_submit (struct disk_request *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
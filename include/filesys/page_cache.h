@@ -1,6 +1,7 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include "devices/disk.h"
 
 struct page;
 enum vm_type;
@@ -9,4 +10,10 @@ struct page_cache {};
 
 void page_cache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+
+void page_cache_read (disk_sector_t, void *buffer, int ofs, int size);
+void page_cache_write (disk_sector_t, const void *buffer, int ofs, int size);
+void page_cache_prefetch (disk_sector_t, bool readahead);
+void page_cache_flush (void);
+void page_cache_print_stats (void);
 #endif
@@ -78,4 +78,14 @@ get_fs_disk_write_cnt (void) {
 	return write_cnt;
 }
 
+static inline long long
+get_fs_disk_intr_cnt (void) {
+	long long intr_cnt;
+	asm volatile ("movq $0, %rdx");
+	asm volatile ("movq $1, %rcx");
+	asm volatile ("int $0x45");
+	asm volatile ("\t movq %%rax, %0": "=r" (intr_cnt));
+	return intr_cnt;
+}
+
 #endif /* lib/user/syscall.h */
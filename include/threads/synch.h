@@ -2,13 +2,16 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <heap.h>
 #include <stdbool.h>
 
+struct thread;
+
 /* A counting semaphore. */
 struct semaphore
 {
 	unsigned value;		 /* Current value. */
-	struct list waiters; /* List of waiting threads. */
+	struct heap waiters; /* Waiting threads, highest priority on top. */
 };
 
 void sema_init(struct semaphore *, unsigned value);
@@ -22,6 +25,10 @@ struct lock
 {
 	struct thread *holder;		/* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+
+	/* for priority donation */
+	int priority;		   /* Highest priority of a waiter, or -1. */
+	struct heap_elem elem; /* Element in holder's held_locks. */
 };
 
 void lock_init(struct lock *);
@@ -50,8 +57,8 @@ void cond_broadcast(struct condition *, struct lock *);
 
 #endif /* threads/synch.h */
 
-bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux);
+bool cmp_lock_priority(const struct heap_elem *a, const struct heap_elem *b, void *aux);
+void sema_reorder_waiter(struct thread *t);
 
 void donate_priority(void);
-void remove_with_lock(struct lock *lock);
 void refresh_priority(void);
@@ -99,9 +99,11 @@ struct thread
 
 	/* for priority donation */
 	int origin_priority;
-	struct lock *lock_need;
-	struct list donator_list;
-	struct list_elem d_elem;
+	struct lock *lock_need;		  /* Lock this thread waits for. */
+	struct heap held_locks;		  /* Held locks, by waiter priority. */
+	struct semaphore *sema_need;  /* Semaphore this thread waits on. */
+	struct heap_elem w_elem;	  /* Element in sema_need->waiters. */
+	uint64_t wait_seq;			  /* Keeps waiters FIFO among equals. */
 
 	struct list_elem a_elem;
 
@@ -135,6 +137,7 @@ struct thread
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	uint64_t user_rsp; /* User stack pointer on entry to a syscall. */
 #endif
 
 	/* Owned by thread.c. */
@@ -179,11 +182,11 @@ void do_iret(struct intr_frame *tf);
 #endif /* threads/thread.h */
 
 void thread_sleep(int64_t);
-void update_next_tick_to_awake();
-struct list sleep_list;
-int64_t next_tick_to_awake;
+void thread_awake(int64_t);
+void thread_sleep_stats(long long *wakeups, long long *cascades);
 
 void test_max_priority(void);
+void thread_change_priority(struct thread *t, int priority);
 bool cmp_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
 
 void update_load_avg(void);
@@ -4,10 +4,17 @@
 struct page;
 enum vm_type;
 
+/* Swap slot of a page that is not in swap. */
+#define SLOT_NONE SIZE_MAX
+
 struct anon_page {
+	size_t slot;           /* Swap slot holding a copy of the page,
+	                          if any. */
 };
 
 void vm_anon_init (void);
+void vm_anon_print_stats (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share_slot (struct page *dst, struct page *src);
 
 #endif
@@ -4,9 +4,29 @@
 #include "vm/vm.h"
 
 struct page;
+struct supplemental_page_table;
 enum vm_type;
 
 struct file_page {
+	struct file *file;     /* File the page is mapped from. */
+	off_t ofs;             /* Offset of the page in FILE. */
+	size_t read_bytes;     /* Bytes of FILE in the page; the rest is 0. */
+};
+
+/* Where a lazily loaded page's contents come from.  Passed as the
+ * aux of the page's initializer, which frees it. */
+struct file_load {
+	struct file *file;     /* File to read from. */
+	off_t ofs;             /* Offset of the page in FILE. */
+	size_t read_bytes;     /* Bytes to read; the rest is zeroed. */
+};
+
+/* A mapping created by mmap(), kept in its process's SPT. */
+struct mmap_region {
+	struct list_elem elem; /* Element in the SPT's region list. */
+	void *start;           /* First mapped page. */
+	void *end;             /* Byte past the last mapped page. */
+	struct file *file;     /* Own reference to the mapped file. */
 };
 
 void vm_file_init (void);
@@ -14,4 +34,6 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+struct mmap_region *mmap_find_region (struct supplemental_page_table *,
+		const void *va);
 #endif
@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +48,13 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;  /* Element in the owner's SPT. */
+	struct list_elem frame_elem; /* Element in the frame's page list. */
+	struct thread *owner;  /* Process whose address space it is in. */
+	bool writable;         /* May the user write to it? */
+	struct inode *text_inode; /* If nonnull, the page is read-only text: */
+	off_t text_ofs;           /* TEXT_BYTES bytes at TEXT_OFS in */
+	size_t text_bytes;        /* TEXT_INODE, then zeros. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +68,24 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * After fork, a frame may be shared copy-on-write by pages of several
+ * processes, all mapped read-only.  PAGE is any one of them. */
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list pages;      /* Pages mapped to the frame. */
+	size_t ref_cnt;         /* Number of pages in PAGES. */
+	struct list_elem elem;  /* Element in the frame table. */
+	int pin_cnt;            /* Not evicted while nonzero. */
+	bool busy;              /* Being written out; do not touch. */
+
+	/* Text held by the frame, for sharing it between processes that
+	 * run the same file. */
+	struct hash_elem text_elem; /* Element in the text frame table. */
+	struct inode *text_inode;   /* Own reference, or null if not text. */
+	off_t text_ofs;             /* Offset of the text in TEXT_INODE. */
+	size_t text_bytes;          /* Bytes read from TEXT_INODE. */
 };
 
 /* The function table for page operations.
@@ -82,9 +105,13 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * Every page is in a hash table keyed by its page-aligned VA, so the
+ * page fault handler finds it in constant time.  The mmap regions are
+ * also kept in a list ordered by start address, so that munmap and the
+ * overlap checks of mmap look at regions rather than pages. */
 struct supplemental_page_table {
+	struct hash pages;     /* All pages, by VA. */
+	struct list regions;   /* struct mmap_region, by start address. */
 };
 
 #include "threads/thread.h"
@@ -96,8 +123,12 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_range_free (struct supplemental_page_table *spt, void *va,
+		size_t length);
 
 void vm_init (void);
+void vm_print_stats (void);
+void vm_count_write_back (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -106,6 +137,9 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
+void vm_free_frame (struct page *page, bool write_back);
+struct frame *vm_prefetch_frame (struct page *page);
+void vm_unpin_frame (struct frame *frame);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
 
@@ -0,0 +1,179 @@
+/* Pairing heap.
+
+   See heap.h for basic information.  The top of the heap is its
+   root; every other element hangs off its parent's `child' list,
+   linked through `next', with `prev' pointing at the parent for
+   the leftmost child and at the left sibling otherwise. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+		struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->size = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->prev = e->next = e->child = NULL;
+	h->root = meld (h, h->root, e);
+	h->size++;
+}
+
+/* Removes the greatest element of H and returns it.
+   H must not be empty. */
+struct heap_elem *
+heap_pop (struct heap *h) {
+	struct heap_elem *top;
+
+	ASSERT (!heap_empty (h));
+
+	top = h->root;
+	h->root = merge_pairs (h, top->child);
+	h->size--;
+	top->child = NULL;
+	return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	ASSERT (!heap_empty (h));
+	ASSERT (e != NULL);
+
+	if (e == h->root) {
+		heap_pop (h);
+		return;
+	}
+
+	detach (e);
+	h->root = meld (h, h->root, merge_pairs (h, e->child));
+	h->size--;
+	e->child = NULL;
+}
+
+/* Restores the heap property after the value of E, which must be
+   in H, changed in either direction. */
+void
+heap_update (struct heap *h, struct heap_elem *e) {
+	heap_remove (h, e);
+	heap_push (h, e);
+}
+
+/* Returns the greatest element of H, or NULL if H is empty. */
+struct heap_elem *
+heap_top (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) {
+	ASSERT (h != NULL);
+	return h->root == NULL;
+}
+
+/* Melds the heap-ordered trees rooted at A and B, either of which
+   may be NULL, and returns the root of the result.  The roots
+   must not have siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+
+	if (h->less (a, b, h->aux)) {
+		struct heap_elem *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	/* B becomes the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->prev = a->next = NULL;
+	return a;
+}
+
+/* Melds the list of sibling trees starting at FIRST into a
+   single tree and returns its root, using the standard two-pass
+   pairing.  Runs iteratively so that long sibling lists cannot
+   overflow the kernel stack. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* Left to right: meld adjacent pairs, collecting the results
+	   in reverse order through `next'. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+		struct heap_elem *m;
+
+		a->prev = a->next = NULL;
+		if (b != NULL) {
+			first = b->next;
+			b->prev = b->next = NULL;
+			m = meld (h, a, b);
+		} else {
+			first = NULL;
+			m = a;
+		}
+		m->next = pairs;
+		pairs = m;
+	}
+
+	/* Right to left: meld each pair into the accumulated root. */
+	while (pairs != NULL) {
+		struct heap_elem *next = pairs->next;
+		pairs->next = NULL;
+		root = meld (h, root, pairs);
+		pairs = next;
+	}
+	return root;
+}
+
+/* Cuts E, together with its subtree, out of its parent's list of
+   children.  E must not be a root. */
+static void
+detach (struct heap_elem *e) {
+	ASSERT (e->prev != NULL);
+
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->prev = e->next = NULL;
+}
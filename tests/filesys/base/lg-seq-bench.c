@@ -0,0 +1,52 @@
+/* Writes out a fairly large file sequentially, as lg-seq-block
+   does, then reads it back in large blocks and reports how many
+   sectors the file system disk transferred per interrupt. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 75678
+#define BLOCK_SIZE 8192
+
+static char buf[TEST_SIZE];
+static char buf2[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "noodle";
+  long long read_cnt, intr_cnt;
+  size_t ofs;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\" for reading", file_name);
+  read_cnt = get_fs_disk_read_cnt ();
+  intr_cnt = get_fs_disk_intr_cnt ();
+  for (ofs = 0; ofs < sizeof buf2; ofs += BLOCK_SIZE) 
+    {
+      size_t block_size = sizeof buf2 - ofs;
+      if (block_size > BLOCK_SIZE)
+        block_size = BLOCK_SIZE;
+      if (read (fd, buf2 + ofs, block_size) != (int) block_size)
+        fail ("read %zu bytes at offset %zu in \"%s\" failed",
+              block_size, ofs, file_name);
+    }
+  read_cnt = get_fs_disk_read_cnt () - read_cnt;
+  intr_cnt = get_fs_disk_intr_cnt () - intr_cnt;
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  compare_bytes (buf2, buf, sizeof buf, 0, file_name);
+  msg ("verified contents of \"%s\"", file_name);
+  msg ("read %lld sectors in %lld interrupts", read_cnt, intr_cnt);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($sectors, $interrupts);
+local ($_);
+foreach (@output) {
+    ($sectors, $interrupts) = ($1, $2)
+      if /read (\d+) sectors in (\d+) interrupts/;
+}
+
+fail "Missing sector and interrupt counts.\n" if !defined $sectors;
+fail "File contents were not verified.\n"
+  if !grep (/verified contents of "noodle"/, @output);
+fail "Read $sectors sectors but took no interrupts.\n"
+  if $sectors > 0 && $interrupts == 0;
+pass;
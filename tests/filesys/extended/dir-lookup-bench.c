@@ -0,0 +1,56 @@
+/* Creates 1000 files in the root directory, then opens each of
+   them by name and reports how long the lookups took, in CPU
+   cycles, and how many sectors the file system disk read for
+   them.  Finally removes all the files again. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 1000
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  long long read_cnt;
+  uint64_t cycles;
+  size_t i;
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+  quiet = false;
+  msg ("created %d files", FILE_CNT);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  cycles = rdtsc ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      fd = open (file_name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+  cycles = rdtsc () - cycles;
+  read_cnt = get_fs_disk_read_cnt () - read_cnt;
+  msg ("looked up %d files in %llu cycles and %lld sector reads",
+       FILE_CNT, (unsigned long long) cycles, read_cnt);
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+  quiet = false;
+  msg ("removed %d files", FILE_CNT);
+}
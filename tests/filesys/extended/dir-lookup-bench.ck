@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($files, $cycles, $sectors);
+local ($_);
+foreach (@output) {
+    ($files, $cycles, $sectors) = ($1, $2, $3)
+      if /looked up (\d+) files in (\d+) cycles and (\d+) sector reads/;
+}
+
+fail "Missing lookup counts.\n" if !defined $files;
+fail "Files were not all created.\n"
+  if !grep (/created $files files/, @output);
+fail "Files were not all removed.\n"
+  if !grep (/removed $files files/, @output);
+
+# Each lookup should read the file's inode and at most a couple of
+# directory sectors, not scan the whole directory.
+fail "Read $sectors sectors to look up $files files.\n"
+  if $sectors > 3 * $files;
+pass;
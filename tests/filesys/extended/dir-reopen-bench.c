@@ -0,0 +1,38 @@
+/* Opens and closes the same file 10,000 times and reports how
+   long that took, in CPU cycles, and how many sectors the file
+   system disk read meanwhile.  Repeated lookups of the same name
+   should be served from the directory entry cache. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 10000
+
+void
+test_main (void) 
+{
+  const char *file_name = "hot";
+  long long read_cnt;
+  uint64_t cycles;
+  int i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  cycles = rdtsc ();
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      int fd = open (file_name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+  cycles = rdtsc () - cycles;
+  read_cnt = get_fs_disk_read_cnt () - read_cnt;
+  msg ("opened \"%s\" %d times in %llu cycles and %lld sector reads",
+       file_name, OPEN_CNT, (unsigned long long) cycles, read_cnt);
+
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($opens, $cycles, $sectors);
+local ($_);
+foreach (@output) {
+    ($opens, $cycles, $sectors) = ($1, $2, $3)
+      if /opened "hot" (\d+) times in (\d+) cycles and (\d+) sector reads/;
+}
+
+fail "Missing open counts.\n" if !defined $opens;
+fail "File was not removed.\n" if !grep (/remove "hot"/, @output);
+
+# The name, the directory and the inode all stay cached, so
+# reopening the file should hardly touch the disk.
+fail "Read $sectors sectors to open one file $opens times.\n"
+  if $sectors > 16;
+pass;
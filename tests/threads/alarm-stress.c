@@ -0,0 +1,95 @@
+/* Creates 1000 threads, each of which sleeps until a random
+   deadline within the next few seconds.  Verifies that no thread
+   wakes up early, and reports how much work the timer interrupt
+   handler did to wake them all. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 1000         /* Number of sleeping threads. */
+#define MAX_SLEEP 500           /* Latest deadline, in ticks. */
+
+/* Information about an individual thread in the test. */
+struct stress_thread 
+  {
+    int64_t wakeup;             /* Tick to wake up at. */
+    int64_t woken;              /* Tick actually woken up at. */
+    struct semaphore *done;     /* Upped when the thread wakes. */
+  };
+
+static void sleeper (void *);
+
+void
+test_alarm_stress (void) 
+{
+  struct stress_thread *threads;
+  struct semaphore done;
+  long long wakeups, cascades, wakeups0, cascades0;
+  int64_t start_ticks, ticks;
+  uint64_t start_cycles, cycles;
+  int early;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep until random deadlines.", THREAD_CNT);
+
+  threads = malloc (sizeof *threads * THREAD_CNT);
+  if (threads == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  sema_init (&done, 0);
+  thread_sleep_stats (&wakeups0, &cascades0);
+  start_cycles = timer_intr_cycles ();
+  start_ticks = timer_ticks ();
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      struct stress_thread *t = &threads[i];
+      char name[16];
+
+      t->wakeup = start_ticks + 100 + random_ulong () % MAX_SLEEP;
+      t->done = &done;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, t);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  ticks = timer_elapsed (start_ticks);
+  cycles = timer_intr_cycles () - start_cycles;
+  thread_sleep_stats (&wakeups, &cascades);
+
+  early = 0;
+  for (i = 0; i < THREAD_CNT; i++)
+    if (threads[i].woken < threads[i].wakeup)
+      early++;
+  msg ("%d threads woke up early.", early);
+  msg ("Sleep queue: %lld wakeups, %lld cascades.",
+       wakeups - wakeups0, cascades - cascades0);
+  msg ("Timer interrupt: %"PRId64" ticks, %"PRIu64" cycles, "
+       "%"PRIu64" cycles/tick.", ticks, cycles,
+       ticks > 0 ? cycles / ticks : 0);
+
+  free (threads);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *t_) 
+{
+  struct stress_thread *t = t_;
+
+  timer_sleep (t->wakeup - timer_ticks ());
+  t->woken = timer_ticks ();
+  sema_up (t->done);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($early, $wakeups, $cascades);
+local ($_);
+foreach (@output) {
+    $early = $1 if /(\d+) threads woke up early\./;
+    ($wakeups, $cascades) = ($1, $2)
+      if /Sleep queue: (\d+) wakeups, (\d+) cascades\./;
+}
+
+fail "Missing count of early wakeups.\n" if !defined $early;
+fail "$early threads woke up early.\n" if $early != 0;
+fail "Missing sleep queue statistics.\n" if !defined $wakeups;
+fail "Expected 1000 wakeups, got $wakeups.\n" if $wakeups != 1000;
+
+# Each sleeper may move down at most once per level of the wheel.
+fail "Too many cascades ($cascades) for 1000 sleepers.\n"
+  if $cascades > 1000 * 4;
+pass;
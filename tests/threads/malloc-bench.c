@@ -0,0 +1,90 @@
+/* Measures how many malloc()/free() pairs the kernel allocator
+   can perform per timer tick, for several block sizes.  The
+   "pairs" pattern frees each block right after allocating it,
+   which the per-descriptor magazines serve without taking the
+   descriptor lock; the "batch" pattern allocates BATCH_CNT blocks
+   before freeing them, which repeatedly drains and overflows the
+   magazines.  Run on kernels before and after an allocator change
+   to compare. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define BENCH_TICKS 20          /* Ticks to run each pattern for. */
+#define BATCH_CNT 64            /* Blocks allocated per batch. */
+
+static long long bench_pairs (size_t size);
+static long long bench_batch (size_t size);
+
+void
+test_malloc_bench (void) 
+{
+  static const size_t sizes[] = {16, 64, 256, 1024};
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++) 
+    {
+      long long pairs = bench_pairs (sizes[i]);
+      long long batch = bench_batch (sizes[i]);
+
+      msg ("%4zu bytes: %lld pairs/tick, %lld batched pairs/tick.",
+           sizes[i], pairs / BENCH_TICKS, batch / BENCH_TICKS);
+    }
+}
+
+/* Waits for the start of a new tick and returns it. */
+static int64_t
+start_tick (void) 
+{
+  int64_t start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+  return start + 1;
+}
+
+/* Returns the number of malloc()/free() pairs of SIZE bytes done
+   back to back in BENCH_TICKS ticks. */
+static long long
+bench_pairs (size_t size) 
+{
+  int64_t start = start_tick ();
+  long long cnt = 0;
+
+  while (timer_elapsed (start) < BENCH_TICKS) 
+    {
+      void *p = malloc (size);
+      if (p == NULL)
+        fail ("malloc (%zu) failed", size);
+      free (p);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Returns the number of malloc()/free() pairs of SIZE bytes done
+   in batches of BATCH_CNT in BENCH_TICKS ticks. */
+static long long
+bench_batch (size_t size) 
+{
+  void *blocks[BATCH_CNT];
+  int64_t start = start_tick ();
+  long long cnt = 0;
+
+  while (timer_elapsed (start) < BENCH_TICKS) 
+    {
+      int i;
+
+      for (i = 0; i < BATCH_CNT; i++) 
+        {
+          blocks[i] = malloc (size);
+          if (blocks[i] == NULL)
+            fail ("malloc (%zu) failed", size);
+        }
+      for (i = 0; i < BATCH_CNT; i++)
+        free (blocks[i]);
+      cnt += BATCH_CNT;
+    }
+  return cnt;
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($lines) = 0;
+local ($_);
+foreach (@output) {
+    my ($size, $pairs, $batch)
+      = /(\d+) bytes: (\d+) pairs\/tick, (\d+) batched pairs\/tick\./
+      or next;
+    fail "No malloc/free pairs completed for $size-byte blocks.\n"
+      if $pairs == 0 || $batch == 0;
+    $lines++;
+}
+fail "Expected results for 4 block sizes, got $lines.\n" if $lines != 4;
+pass;
@@ -0,0 +1,93 @@
+/* Benchmark variant of mlfqs-load-60 with 500 threads.  Starts 500
+   threads that each sleep for 10 seconds, then spin in a tight
+   loop for 20 seconds, and sleep for another 10 seconds.  Every 2
+   seconds after the initial sleep, the main thread prints the
+   load average and the average number of TSC cycles the timer
+   interrupt handler took per tick over the last 2 seconds.
+
+   With MLFQS bookkeeping that does not depend on the number of
+   threads, the cycles per tick should stay roughly flat whether
+   500 threads are spinning, sleeping, or gone.
+
+   The expected load averages are those of 500 ready threads for
+   20 seconds followed by none (some margin of error is allowed):
+
+   After 0 seconds, load average=8.33.
+   After 2 seconds, load average=24.59.
+   After 4 seconds, load average=40.30.
+   ...
+   After 18 seconds, load average=136.68.
+   After 20 seconds, load average=140.36.
+   ...
+   After 48 seconds, load average=87.67.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static int64_t start_time;
+
+static void load_thread (void *aux);
+
+#define THREAD_CNT 500
+
+void
+test_mlfqs_load_500 (void) 
+{
+  int64_t last_ticks;
+  uint64_t last_cycles;
+  int i;
+  
+  ASSERT (thread_mlfqs);
+
+  start_time = timer_ticks ();
+  msg ("Starting %d niced load threads...", THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf(name, sizeof name, "load %d", i);
+      thread_create (name, PRI_DEFAULT, load_thread, NULL);
+    }
+  msg ("Starting threads took %d seconds.",
+       timer_elapsed (start_time) / TIMER_FREQ);
+  
+  last_ticks = timer_ticks ();
+  last_cycles = timer_intr_cycles ();
+  for (i = 0; i < 25; i++) 
+    {
+      int64_t sleep_until = start_time + TIMER_FREQ * (2 * i + 10);
+      int64_t ticks;
+      uint64_t cycles;
+      int load_avg;
+
+      timer_sleep (sleep_until - timer_ticks ());
+      load_avg = thread_get_load_avg ();
+      ticks = timer_ticks () - last_ticks;
+      cycles = timer_intr_cycles () - last_cycles;
+      last_ticks += ticks;
+      last_cycles += cycles;
+      msg ("After %d seconds, load average=%d.%02d, %"PRIu64" cycles/tick.",
+           i * 2, load_avg / 100, load_avg % 100,
+           ticks > 0 ? cycles / ticks : 0);
+    }
+}
+
+static void
+load_thread (void *aux UNUSED) 
+{
+  int64_t sleep_time = 10 * TIMER_FREQ;
+  int64_t spin_time = sleep_time + 20 * TIMER_FREQ;
+  int64_t exit_time = spin_time + 10 * TIMER_FREQ;
+
+  thread_set_nice (20);
+  timer_sleep (sleep_time - timer_elapsed (start_time));
+  while (timer_elapsed (start_time) < spin_time)
+    continue;
+  timer_sleep (exit_time - timer_elapsed (start_time));
+}
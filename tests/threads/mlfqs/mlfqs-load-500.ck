@@ -0,0 +1,39 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::mlfqs;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Get actual values.
+local ($_);
+my (@actual);
+my ($cycle_lines) = 0;
+foreach (@output) {
+    my ($t, $load_avg, $cycles)
+      = /After (\d+) seconds, load average=(\d+\.\d+), (\d+) cycles\/tick\./
+      or next;
+    $actual[$t] = $load_avg;
+    $cycle_lines++;
+}
+fail "Missing per-tick interrupt cost.\n" if $cycle_lines == 0;
+
+# Calculate expected values.
+my ($load_avg) = 0;
+my (@expected);
+for (my ($t) = 0; $t < 50; $t++) {
+    my ($ready) = $t < 20 ? 500 : 0;
+    $load_avg = (59/60) * $load_avg + (1/60) * $ready;
+    $expected[$t] = $load_avg;
+}
+
+mlfqs_compare ("time", "%.2f", \@actual, \@expected, 10, [2, 48, 2],
+	       "Some load average values were missing or "
+	       . "differed from those expected "
+	       . "by more than 10.");
+pass;
@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_stress;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -25,6 +26,7 @@ extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
+extern test_func test_mlfqs_load_500;
 extern test_func test_mlfqs_load_avg;
 extern test_func test_mlfqs_recent_1;
 extern test_func test_mlfqs_fair_2;
@@ -32,6 +34,7 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_malloc_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
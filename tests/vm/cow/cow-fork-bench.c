@@ -0,0 +1,73 @@
+/* Makes 8 MB of memory resident, then forks and reports how long
+   fork took, in CPU cycles.  The child then writes to every page,
+   which makes it copy each of them, and reports how long that took.
+   With copy-on-write, fork only shares the parent's frames, so it
+   should take much less time than the child's copying.  Afterward,
+   the parent writes to every page as well, and each process checks
+   that it never sees the other's writes. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (8 * 1024 * 1024)
+#define PAGE_SIZE 4096
+
+static char buf[SIZE];
+
+/* Writes B to the first byte of every page of BUF. */
+static void
+fill_pages (char b)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    buf[i] = b;
+}
+
+/* Checks that the first byte of every page of BUF is B, as seen
+   by process WHO. */
+static void
+check_pages (char b, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    if (buf[i] != b)
+      fail ("%s sees 0x%02x at offset %zu, expected 0x%02x",
+            who, buf[i] & 0xff, i, b & 0xff);
+}
+
+void
+test_main (void)
+{
+  uint64_t cycles;
+  pid_t child;
+
+  fill_pages (0x5a);
+
+  cycles = rdtsc ();
+  child = fork ("child");
+  if (child == 0)
+    {
+      check_pages (0x5a, "child");
+      cycles = rdtsc ();
+      fill_pages (0xc3);
+      cycles = rdtsc () - cycles;
+      check_pages (0xc3, "child");
+      msg ("child copied %d MB on write in %llu cycles",
+           SIZE / 1024 / 1024, (unsigned long long) cycles);
+      exit (0);
+    }
+  cycles = rdtsc () - cycles;
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == 0, "wait for child");
+
+  check_pages (0x5a, "parent");
+  fill_pages (0x3c);
+  check_pages (0x3c, "parent");
+  msg ("forked a process with %d MB resident in %llu cycles",
+       SIZE / 1024 / 1024, (unsigned long long) cycles);
+}
@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($size, $cycles, $copy_cycles);
+local ($_);
+foreach (@output) {
+    ($size, $cycles) = ($1, $2)
+      if /forked a process with (\d+) MB resident in (\d+) cycles/;
+    $copy_cycles = $1 if /child copied \d+ MB on write in (\d+) cycles/;
+}
+
+fail "Missing fork timing.\n" if !defined $cycles;
+fail "Missing copy timing.\n" if !defined $copy_cycles;
+fail "Child did not exit cleanly.\n" if !grep (/wait for child/, @output);
+
+# Copying every resident page is what fork would do without
+# copy-on-write, so fork has to take less time than the child took
+# to copy the pages when it wrote to them.
+fail "Fork took $cycles cycles with $size MB resident, no less than "
+  . "the $copy_cycles cycles it took to copy the pages on write.\n"
+  if $cycles >= $copy_cycles;
+pass;
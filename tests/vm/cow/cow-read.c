@@ -0,0 +1,47 @@
+/* Fills two pages, forks, and has the child read() a file into
+   them across the page boundary.  The kernel writes those pages on
+   the child's behalf while the parent still shares them, so it has
+   to copy them first, just as for a write from user code.  The
+   parent then checks that its pages are unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char buf[2 * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+  size_t size = sizeof sample - 1;
+  char *dst = buf + PAGE_SIZE - size / 2;
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'x', sizeof buf);
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      int handle;
+
+      CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+      CHECK (read (handle, dst, size) == (int) size,
+             "read \"sample.txt\" into shared pages");
+      if (memcmp (dst, sample, size))
+        fail ("child read bad data");
+      close (handle);
+      return;
+    }
+  wait (child);
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'x')
+      fail ("parent sees 0x%02x at offset %zu, expected 'x'",
+            buf[i] & 0xff, i);
+  msg ("parent's pages unchanged");
+}
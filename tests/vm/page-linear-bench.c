@@ -0,0 +1,45 @@
+/* Touches each page of a 4 MB buffer once, which faults every page
+   in, then touches them all again, and reports how long each pass
+   took, in CPU cycles.  The difference between the passes is the
+   cost of servicing the page faults. */
+
+#include <stdint.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE];
+
+/* Writes one byte into each page of BUF and returns the number of
+   cycles that took. */
+static uint64_t
+touch_pages (char value)
+{
+  uint64_t cycles = rdtsc ();
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = value;
+  return rdtsc () - cycles;
+}
+
+void
+test_main (void)
+{
+  uint64_t faulting, resident;
+  size_t i;
+
+  faulting = touch_pages (0x5a);
+  resident = touch_pages (0x5b);
+  msg ("faulted in %d pages in %llu cycles, touched them again in %llu cycles",
+       PAGE_CNT, (unsigned long long) faulting,
+       (unsigned long long) resident);
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i % PAGE_SIZE == 0 ? 0x5b : 0))
+      fail ("byte %zu has wrong value %d", i, buf[i]);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($pages, $faulting, $resident);
+local ($_);
+foreach (@output) {
+    ($pages, $faulting, $resident) = ($1, $2, $3)
+      if /faulted in (\d+) pages in (\d+) cycles, touched them again in (\d+) cycles/;
+}
+
+fail "Missing page fault timings.\n" if !defined $pages;
+fail "No pages were touched.\n" if $pages == 0;
+fail "First touch of $pages pages took $faulting cycles, no more than "
+  . "the $resident cycles of touching them again, so it cannot have "
+  . "faulted them in.\n"
+  if $faulting <= $resident;
+pass;
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -17,29 +18,48 @@
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
+   Otherwise, blocks are carved off the descriptor's current
+   "arena", a page of memory obtained from the page allocator, one
+   at a time as they are needed.  When that arena is used up, a
+   new one is obtained (if none is available, malloc() returns a
+   null pointer).
 
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   The free list is protected by the descriptor's lock, which may
+   block and cause priority donation.  To keep that off the common
+   path, each descriptor also has a "magazine", a small stack of
+   free blocks that is accessed with interrupts briefly disabled
+   instead.  malloc() pops from the magazine and free() pushes onto
+   it; only when the magazine runs empty or full is the lock taken,
+   and then MAG_BATCH blocks are moved at once.  Blocks sitting in
+   a magazine still count as in use for their arena.
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
+/* Magazine capacity and the number of blocks moved between a
+   magazine and its descriptor at once. */
+#define MAG_SIZE 32
+#define MAG_BATCH (MAG_SIZE / 2)
+
 /* Descriptor. */
 struct desc {
 	size_t block_size;          /* Size of each element in bytes. */
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
+	struct arena *carve_arena;  /* Arena with uncarved blocks, if any. */
 	struct lock lock;           /* Lock. */
+
+	/* Magazine, accessed with interrupts off. */
+	struct block *mag[MAG_SIZE];
+	size_t mag_cnt;
 };
 
 /* Magic number for detecting arena corruption. */
@@ -50,6 +70,7 @@ struct arena {
 	unsigned magic;             /* Always set to ARENA_MAGIC. */
 	struct desc *desc;          /* Owning descriptor, null for big block. */
 	size_t free_cnt;            /* Free blocks; pages in big block. */
+	size_t carved;              /* Blocks handed out at least once. */
 };
 
 /* Free block. */
@@ -63,6 +84,8 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static size_t desc_get_blocks (struct desc *, struct block **, size_t cnt);
+static void desc_put_blocks (struct desc *, struct block **, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -75,7 +98,9 @@ malloc_init (void) {
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
+		d->carve_arena = NULL;
 		lock_init (&d->lock);
+		d->mag_cnt = 0;
 	}
 }
 
@@ -112,34 +137,31 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
+	/* Fast path: take a block from the magazine. */
+	enum intr_level old_level = intr_disable ();
+	if (d->mag_cnt > 0) {
+		b = d->mag[--d->mag_cnt];
+		intr_set_level (old_level);
+		return b;
+	}
+	intr_set_level (old_level);
 
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	/* Slow path: refill the magazine from the descriptor and
+	   return one of the new blocks. */
+	struct block *batch[MAG_BATCH];
+	size_t cnt = desc_get_blocks (d, batch, MAG_BATCH);
+	if (cnt == 0)
+		return NULL;
+	b = batch[--cnt];
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
+	old_level = intr_disable ();
+	while (cnt > 0 && d->mag_cnt < MAG_SIZE)
+		d->mag[d->mag_cnt++] = batch[--cnt];
+	intr_set_level (old_level);
 
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
-	}
-
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
-	lock_release (&d->lock);
+	/* Someone else refilled the magazine meanwhile. */
+	if (cnt > 0)
+		desc_put_blocks (d, batch, cnt);
 	return b;
 }
 
@@ -213,24 +235,23 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			/* Fast path: put the block in the magazine. */
+			enum intr_level old_level = intr_disable ();
+			if (d->mag_cnt < MAG_SIZE) {
+				d->mag[d->mag_cnt++] = b;
+				intr_set_level (old_level);
+				return;
 			}
 
-			lock_release (&d->lock);
+			/* Slow path: the magazine is full.  Return a batch of
+			   blocks, including this one, to the descriptor. */
+			struct block *batch[MAG_BATCH];
+			size_t cnt = 0;
+			while (cnt < MAG_BATCH - 1)
+				batch[cnt++] = d->mag[--d->mag_cnt];
+			intr_set_level (old_level);
+			batch[cnt++] = b;
+			desc_put_blocks (d, batch, cnt);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +260,79 @@ free (void *p) {
 	}
 }
 
+/* Takes up to CNT blocks from descriptor D's free list, carving
+   new blocks from D's arena when the free list runs out, and
+   stores them in BLOCKS.  Returns the number of blocks obtained,
+   which is 0 only if no page is available for a new arena. */
+static size_t
+desc_get_blocks (struct desc *d, struct block **blocks, size_t cnt) {
+	size_t got = 0;
+
+	lock_acquire (&d->lock);
+	while (got < cnt) {
+		struct block *b;
+		struct arena *a;
+
+		if (!list_empty (&d->free_list)) {
+			b = list_entry (list_pop_front (&d->free_list), struct block,
+					free_elem);
+			a = block_to_arena (b);
+		} else {
+			/* Carve the next block, obtaining a new arena first if
+			   the current one is used up. */
+			a = d->carve_arena;
+			if (a == NULL || a->carved >= d->blocks_per_arena) {
+				a = palloc_get_page (0);
+				if (a == NULL)
+					break;
+				a->magic = ARENA_MAGIC;
+				a->desc = d;
+				a->free_cnt = d->blocks_per_arena;
+				a->carved = 0;
+				d->carve_arena = a;
+			}
+			b = arena_to_block (a, a->carved++);
+		}
+		a->free_cnt--;
+		blocks[got++] = b;
+	}
+	lock_release (&d->lock);
+	return got;
+}
+
+/* Returns the CNT blocks in BLOCKS to descriptor D's free list,
+   giving each arena that becomes entirely unused back to the page
+   allocator. */
+static void
+desc_put_blocks (struct desc *d, struct block **blocks, size_t cnt) {
+	size_t i;
+
+	lock_acquire (&d->lock);
+	for (i = 0; i < cnt; i++) {
+		struct block *b = blocks[i];
+		struct arena *a = block_to_arena (b);
+
+		/* Add block to free list. */
+		list_push_front (&d->free_list, &b->free_elem);
+
+		/* If the arena is now entirely unused, free it.  Only the
+		   blocks carved so far can be on the free list. */
+		if (++a->free_cnt >= d->blocks_per_arena) {
+			size_t j;
+
+			ASSERT (a->free_cnt == d->blocks_per_arena);
+			for (j = 0; j < a->carved; j++) {
+				struct block *b = arena_to_block (a, j);
+				list_remove (&b->free_elem);
+			}
+			if (d->carve_arena == a)
+				d->carve_arena = NULL;
+			palloc_free_page (a);
+		}
+	}
+	lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -2,14 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +25,69 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   aligned to their size relative to the pool base, on one free
+   list per order.  A request for PAGE_CNT pages splits the
+   smallest sufficient block down to the right order and returns
+   the unused tail of that block; freeing merges a block with its
+   buddy for as long as the buddy is free, so both take O(log n)
+   time.  The header of a free block is stored in its first page,
+   and head_map marks the pages that start a free block, so that
+   a buddy's state can be checked without touching pages in use.
+
+   Every buddy operation is O(log n), so the pool is protected by
+   disabling interrupts rather than by a lock.  That also lets
+   pages be freed from inside the scheduler, where a thread must
+   not block.
+
+   Most requests are for a single page, so each pool also keeps a
+   small stack of free single pages in front of the buddy
+   allocator.  It is refilled from, and spilled back to, the buddy
+   allocator PAGE_CACHE_BATCH pages at a time, so the common case
+   is a push or pop with interrupts off for a few instructions.
+   A second stack holds pages that are known to be zeroed.  The
+   idle thread tops it up by calling palloc_prezero() when there is
+   nothing else to run, so that PAL_ZERO requests for single pages
+   usually do not have to clear memory. */
+
+/* Number of buddy orders: blocks of up to 2**(BUDDY_ORDERS - 1)
+   pages, i.e. 4 GB. */
+#define BUDDY_ORDERS 21
+
+/* Capacity of each single-page stack, and the number of pages
+   moved between a stack and the buddy allocator at a time. */
+#define PAGE_CACHE_SIZE 64
+#define PAGE_CACHE_BATCH 16
+
+/* Number of zeroed pages the idle thread keeps per pool. */
+#define ZERO_TARGET 32
+
+/* A stack of free single pages.  They are still marked as in
+   use in the pool's used_map. */
+struct page_stack {
+	void *pages[PAGE_CACHE_SIZE];   /* Cached pages. */
+	size_t cnt;                     /* Number of cached pages. */
+};
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct bitmap *used_map;        /* Bitmap of pages in use. */
+	struct bitmap *head_map;        /* Bitmap of free block heads. */
+	struct list free_lists[BUDDY_ORDERS]; /* Free blocks by order. */
 	uint8_t *base;                  /* Base of pool. */
+	struct page_stack dirty;        /* Cached pages, any contents. */
+	struct page_stack zeroed;       /* Cached pages, all zeros. */
+	long long zero_hits;            /* PAL_ZERO pages found zeroed. */
+	long long zero_misses;          /* PAL_ZERO pages cleared on demand. */
+};
+
+/* Header of a free buddy block, kept in its first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in pool's free_lists. */
+	unsigned order;                 /* Block is 2**ORDER pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +95,18 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void buddy_populate (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void pool_print_stats (const char *name, struct pool *);
+static void *cache_get (struct pool *, bool want_zero, bool *zeroed);
+static void cache_put (struct pool *, void *page);
+static bool cache_drain (struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -250,6 +315,8 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	buddy_populate (&kernel_pool);
+	buddy_populate (&user_pool);
 	return ext_mem.end;
 }
 
@@ -262,20 +329,33 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	bool zeroed = false;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	if (page_cnt == 1)
+		pages = cache_get (pool, flags & PAL_ZERO, &zeroed);
+	else {
+		enum intr_level old_level = intr_disable ();
+		size_t page_idx = buddy_alloc (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR && cache_drain (pool))
+			page_idx = buddy_alloc (pool, page_cnt);
+		intr_set_level (old_level);
+
+		if (page_idx != BITMAP_ERROR)
+			pages = pool->base + PGSIZE * page_idx;
+		else
+			pages = NULL;
+	}
 
 	if (pages) {
-		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
+		if (flags & PAL_ZERO) {
+			if (zeroed)
+				pool->zero_hits++;
+			else {
+				pool->zero_misses += page_cnt;
+				memset (pages, 0, PGSIZE * page_cnt);
+			}
+		}
 	} else {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
@@ -318,8 +398,13 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	enum intr_level old_level = intr_disable ();
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (page_cnt == 1)
+		cache_put (pool, pages);
+	else
+		buddy_free (pool, page_idx, page_cnt);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -336,15 +421,19 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	int i;
 
-	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->head_map = bitmap_create_in_buf (pgcnt, *bm_base + bm_pages, bm_pages);
 	p->base = (void *) start;
+	for (i = 0; i < BUDDY_ORDERS; i++)
+		list_init (&p->free_lists[i]);
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
+	bitmap_set_all(p->head_map, false);
 
-	*bm_base += bm_pages;
+	*bm_base += 2 * bm_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -356,3 +445,295 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block header stored at page PAGE_IDX of POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t page_idx) {
+	return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the page index of free block B within POOL. */
+static size_t
+block_to_idx (struct pool *pool, struct free_block *b) {
+	return pg_no (b) - pg_no (pool->base);
+}
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static unsigned
+cnt_to_order (size_t page_cnt) {
+	unsigned order = 0;
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	return order;
+}
+
+/* Puts the block of 2**ORDER pages at PAGE_IDX on POOL's free
+   list, merging it with its buddy as long as the buddy is free. */
+static void
+buddy_insert (struct pool *pool, size_t page_idx, unsigned order) {
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	struct free_block *b;
+
+	while (order + 1 < BUDDY_ORDERS) {
+		size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+		struct free_block *buddy;
+
+		if (buddy_idx + ((size_t) 1 << order) > pool_cnt
+				|| !bitmap_test (pool->head_map, buddy_idx))
+			break;
+		buddy = idx_to_block (pool, buddy_idx);
+		if (buddy->order != order)
+			break;
+
+		list_remove (&buddy->elem);
+		bitmap_reset (pool->head_map, buddy_idx);
+		if (buddy_idx < page_idx)
+			page_idx = buddy_idx;
+		order++;
+	}
+
+	b = idx_to_block (pool, page_idx);
+	b->order = order;
+	list_push_front (&pool->free_lists[order], &b->elem);
+	bitmap_mark (pool->head_map, page_idx);
+}
+
+/* Marks the PAGE_CNT pages starting at PAGE_IDX in POOL free,
+   splitting the range into the largest aligned blocks it
+   contains. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	while (page_cnt > 0) {
+		unsigned order = 0;
+
+		while (order + 1 < BUDDY_ORDERS
+				&& page_idx % ((size_t) 1 << (order + 1)) == 0
+				&& ((size_t) 1 << (order + 1)) <= page_cnt)
+			order++;
+		buddy_insert (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   large enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	unsigned want = cnt_to_order (page_cnt);
+	unsigned order;
+	struct free_block *b;
+	size_t page_idx;
+
+	if (page_cnt == 0 || want >= BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	/* Find the smallest free block that is large enough. */
+	for (order = want; order < BUDDY_ORDERS; order++)
+		if (!list_empty (&pool->free_lists[order]))
+			break;
+	if (order == BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	b = list_entry (list_pop_front (&pool->free_lists[order]),
+			struct free_block, elem);
+	page_idx = block_to_idx (pool, b);
+	bitmap_reset (pool->head_map, page_idx);
+
+	/* Split it down to the requested order, freeing upper halves. */
+	while (order > want) {
+		order--;
+		buddy_insert (pool, page_idx + ((size_t) 1 << order), order);
+	}
+
+	/* Give back the pages beyond PAGE_CNT. */
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	if (page_cnt < ((size_t) 1 << want))
+		buddy_free (pool, page_idx + page_cnt,
+				((size_t) 1 << want) - page_cnt);
+	return page_idx;
+}
+
+/* Builds POOL's free lists from the free pages in its used_map. */
+static void
+buddy_populate (struct pool *pool) {
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t start = 0;
+
+	while (start < pool_cnt) {
+		size_t end;
+
+		start = bitmap_scan (pool->used_map, start, 1, false);
+		if (start == BITMAP_ERROR)
+			break;
+		end = bitmap_scan (pool->used_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = pool_cnt;
+		buddy_free (pool, start, end - start);
+		start = end;
+	}
+}
+
+/* Pushes PAGE onto stack S.  Returns false if S is full. */
+static bool
+stack_push (struct page_stack *s, void *page) {
+	if (s->cnt >= PAGE_CACHE_SIZE)
+		return false;
+	s->pages[s->cnt++] = page;
+	return true;
+}
+
+/* Pops and returns the top page of stack S, or a null pointer if
+   S is empty. */
+static void *
+stack_pop (struct page_stack *s) {
+	return s->cnt > 0 ? s->pages[--s->cnt] : NULL;
+}
+
+/* Returns up to PAGE_CNT pages from the top of stack S to POOL's
+   buddy allocator. */
+static void
+stack_spill (struct pool *pool, struct page_stack *s, size_t page_cnt) {
+	while (page_cnt-- > 0 && s->cnt > 0) {
+		void *page = stack_pop (s);
+		buddy_free (pool, pg_no (page) - pg_no (pool->base), 1);
+	}
+}
+
+/* Moves up to PAGE_CACHE_BATCH single pages from POOL's buddy
+   allocator onto its dirty stack.  Returns false if none were
+   available.  Interrupts must be off. */
+static bool
+cache_refill (struct pool *pool) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	for (i = 0; i < PAGE_CACHE_BATCH && pool->dirty.cnt < PAGE_CACHE_SIZE;
+			i++) {
+		size_t page_idx = buddy_alloc (pool, 1);
+		if (page_idx == BITMAP_ERROR)
+			break;
+		stack_push (&pool->dirty, pool->base + PGSIZE * page_idx);
+	}
+	return pool->dirty.cnt > 0;
+}
+
+/* Takes a single page from POOL's page stacks, refilling them
+   from the buddy allocator if needed.  Prefers a zeroed page if
+   WANT_ZERO, otherwise one that is not.  Sets *ZEROED to true if
+   the returned page is known to be zeroed.  Returns a null
+   pointer if POOL is out of pages. */
+static void *
+cache_get (struct pool *pool, bool want_zero, bool *zeroed) {
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	*zeroed = false;
+	if (want_zero && (page = stack_pop (&pool->zeroed)) != NULL)
+		*zeroed = true;
+	else if (pool->dirty.cnt > 0 || cache_refill (pool))
+		page = stack_pop (&pool->dirty);
+	else if ((page = stack_pop (&pool->zeroed)) != NULL)
+		*zeroed = true;
+	intr_set_level (old_level);
+
+	return page;
+}
+
+/* Returns free single PAGE to POOL's dirty stack, spilling a
+   batch of pages back to the buddy allocator if the stack is
+   full.  Interrupts must be off. */
+static void
+cache_put (struct pool *pool, void *page) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (pool->dirty.cnt >= PAGE_CACHE_SIZE)
+		stack_spill (pool, &pool->dirty, PAGE_CACHE_BATCH);
+	stack_push (&pool->dirty, page);
+}
+
+/* Returns every page cached by POOL to its buddy allocator, so
+   that they can be merged into larger blocks.  Returns false if
+   there were none.  Interrupts must be off. */
+static bool
+cache_drain (struct pool *pool) {
+	bool drained = pool->dirty.cnt > 0 || pool->zeroed.cnt > 0;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	stack_spill (pool, &pool->dirty, PAGE_CACHE_SIZE);
+	stack_spill (pool, &pool->zeroed, PAGE_CACHE_SIZE);
+	return drained;
+}
+
+/* Zeroes one free page of POOL and adds it to POOL's zeroed
+   stack.  Returns false if POOL already has ZERO_TARGET zeroed
+   pages or no free page to zero. */
+static bool
+zero_one (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	if (pool->zeroed.cnt < ZERO_TARGET
+			&& (pool->dirty.cnt > 0 || cache_refill (pool)))
+		page = stack_pop (&pool->dirty);
+	intr_set_level (old_level);
+	if (page == NULL)
+		return false;
+
+	memset (page, 0, PGSIZE);
+
+	old_level = intr_disable ();
+	if (!stack_push (&pool->zeroed, page))
+		cache_put (pool, page);
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Zeroes one free page and adds it to its pool's zeroed stack,
+   preferring the user pool.  Returns false if both pools already
+   have enough zeroed pages, or have no free page to zero.
+
+   Called by the idle thread, with interrupts on, when no other
+   thread is ready to run. */
+bool
+palloc_prezero (void) {
+	return zero_one (&user_pool) || zero_one (&kernel_pool);
+}
+
+/* Prints fragmentation statistics for POOL, named NAME. */
+static void
+pool_print_stats (const char *name, struct pool *pool) {
+	size_t free_cnt = 0, block_cnt = 0, largest = 0;
+	size_t dirty_cnt, zeroed_cnt;
+	int order;
+
+	enum intr_level old_level = intr_disable ();
+	dirty_cnt = pool->dirty.cnt;
+	zeroed_cnt = pool->zeroed.cnt;
+	for (order = 0; order < BUDDY_ORDERS; order++) {
+		size_t n = list_size (&pool->free_lists[order]);
+		if (n > 0)
+			largest = (size_t) 1 << order;
+		block_cnt += n;
+		free_cnt += n << order;
+	}
+	intr_set_level (old_level);
+
+	printf ("  %s pool: %zu of %zu pages free in %zu blocks, "
+			"largest %zu pages (%zu%% fragmented)\n",
+			name, free_cnt, bitmap_size (pool->used_map), block_cnt, largest,
+			free_cnt > 0 ? 100 - largest * 100 / free_cnt : 0);
+	printf ("  %s pool: %zu single pages cached, %zu of them zeroed\n",
+			name, dirty_cnt + zeroed_cnt, zeroed_cnt);
+	printf ("  %s pool: %lld pre-zeroed page hits, %lld misses\n",
+			name, pool->zero_hits, pool->zero_misses);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Palloc:\n");
+	pool_print_stats ("kernel", &kernel_pool);
+	pool_print_stats ("user", &user_pool);
+}
@@ -32,6 +32,12 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+static bool cmp_waiter_priority(const struct heap_elem *a, const struct heap_elem *b, void *aux);
+static int sema_max_priority(const struct semaphore *sema);
+
+/* Sequence number handed to each new semaphore waiter. */
+static uint64_t next_wait_seq;
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -46,7 +52,7 @@ void sema_init(struct semaphore *sema, unsigned value)
 	ASSERT(sema != NULL);
 
 	sema->value = value;
-	list_init(&sema->waiters);
+	heap_init(&sema->waiters, cmp_waiter_priority, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -68,7 +74,10 @@ void sema_down(struct semaphore *sema)
 	/* keep waiting until sema->value become positive */
 	while (sema->value == 0)
 	{
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, cmp_priority, NULL);
+		struct thread *curr = thread_current();
+		curr->sema_need = sema;
+		curr->wait_seq = next_wait_seq++;
+		heap_push(&sema->waiters, &curr->w_elem);
 		thread_block();
 	}
 	sema->value--;
@@ -110,12 +119,12 @@ void sema_up(struct semaphore *sema)
 	ASSERT(sema != NULL);
 
 	old_level = intr_disable();
-	if (!list_empty(&sema->waiters))
+	if (!heap_empty(&sema->waiters))
 	{
-		/* we have to sort wait_list because there might be priority changed thread due to priority donation.
-		same as in cond_signal() function. */
-		list_sort(&sema->waiters, cmp_priority, NULL);
-		struct thread *t = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
+		/* waiters whose priority changed while blocked have already
+		   been moved by sema_reorder_waiter(), so the top is current. */
+		struct thread *t = heap_entry(heap_pop(&sema->waiters), struct thread, w_elem);
+		t->sema_need = NULL;
 		thread_unblock(t);
 	}
 	sema->value++;
@@ -180,6 +189,7 @@ void lock_init(struct lock *lock)
 
 	lock->holder = NULL;
 	sema_init(&lock->semaphore, 1);
+	lock->priority = -1;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -197,19 +207,26 @@ void lock_acquire(struct lock *lock)
 	ASSERT(!lock_held_by_current_thread(lock));
 
 	struct thread *curr = thread_current();
+	enum intr_level old_level = intr_disable();
 
+	/* Donating before sema_down() is atomic with joining the
+	   waiters, since interrupts stay off until we block. */
 	if (lock->holder && !thread_mlfqs)
 	{
 		curr->lock_need = lock;
-		list_insert_ordered(&lock->holder->donator_list, &curr->d_elem, cmp_priority, NULL);
 		donate_priority();
 	}
 
 	sema_down(&lock->semaphore);
 
+	curr->lock_need = NULL;
 	lock->holder = curr;
+	lock->priority = sema_max_priority(&lock->semaphore);
+	heap_push(&curr->held_locks, &lock->elem);
+	if (!thread_mlfqs && lock->priority > curr->priority)
+		thread_change_priority(curr, lock->priority);
 
-	curr->lock_need = NULL;
+	intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -225,9 +242,15 @@ bool lock_try_acquire(struct lock *lock)
 	ASSERT(lock != NULL);
 	ASSERT(!lock_held_by_current_thread(lock));
 
+	enum intr_level old_level = intr_disable();
 	success = sema_try_down(&lock->semaphore);
 	if (success)
+	{
 		lock->holder = thread_current();
+		lock->priority = sema_max_priority(&lock->semaphore);
+		heap_push(&lock->holder->held_locks, &lock->elem);
+	}
+	intr_set_level(old_level);
 	return success;
 }
 
@@ -242,15 +265,16 @@ void lock_release(struct lock *lock)
 	ASSERT(lock != NULL);
 	ASSERT(lock_held_by_current_thread(lock));
 
+	enum intr_level old_level = intr_disable();
+
 	lock->holder = NULL;
+	heap_remove(&thread_current()->held_locks, &lock->elem);
 
 	if (!thread_mlfqs)
-	{
-		remove_with_lock(lock);
 		refresh_priority();
-	}
 
 	sema_up(&lock->semaphore);
+	intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -268,8 +292,11 @@ struct semaphore_elem
 {
 	struct list_elem elem;		/* List element. */
 	struct semaphore semaphore; /* This semaphore. */
+	struct thread *thread;		/* Thread waiting on it. */
 };
 
+static bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -310,7 +337,8 @@ void cond_wait(struct condition *cond, struct lock *lock)
 	ASSERT(lock_held_by_current_thread(lock));
 
 	sema_init(&waiter.semaphore, 0);
-	list_insert_ordered(&cond->waiters, &waiter.elem, cmp_sem_priority, NULL);
+	waiter.thread = thread_current();
+	list_push_back(&cond->waiters, &waiter.elem);
 
 	lock_release(lock);
 	sema_down(&waiter.semaphore);
@@ -333,8 +361,10 @@ void cond_signal(struct condition *cond, struct lock *lock UNUSED)
 
 	if (!list_empty(&cond->waiters))
 	{
-		list_sort(&cond->waiters, cmp_sem_priority, NULL);
-		sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+		/* list_max() picks the earliest of equal-priority waiters. */
+		struct list_elem *e = list_max(&cond->waiters, cmp_sem_priority, NULL);
+		list_remove(e);
+		sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
 	}
 }
 
@@ -353,73 +383,100 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 		cond_signal(cond, lock);
 }
 
-bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux)
+/* Orders condition variable waiters by the priority of the
+   thread waiting on each. */
+static bool
+cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
 {
 	struct semaphore_elem *sema_a = list_entry(a, struct semaphore_elem, elem);
 	struct semaphore_elem *sema_b = list_entry(b, struct semaphore_elem, elem);
 
-	if (!list_empty(&sema_a->semaphore.waiters))
-	{
-		struct list_elem *x = list_front(&sema_a->semaphore.waiters);
-		if (!list_empty(&sema_b->semaphore.waiters))
-		{
-			struct list_elem *y = list_front(&sema_b->semaphore.waiters);
-
-			struct thread *thread_a = list_entry(x, struct thread, elem);
-			struct thread *thread_b = list_entry(y, struct thread, elem);
-
-			if (thread_a->priority > thread_b->priority)
-				return 1;
-			return 0;
-		}
-	}
-	return 0;
+	return sema_a->thread->priority < sema_b->thread->priority;
 }
 
-/* priority donation을 수행하는 함수 */
-void donate_priority(void)
+/* Orders semaphore waiters by priority, and among equal
+   priorities puts the earlier waiter on top. */
+static bool
+cmp_waiter_priority(const struct heap_elem *a, const struct heap_elem *b, void *aux UNUSED)
 {
-	struct thread *curr = thread_current();
-	while (curr->lock_need)
-	{
-		if (curr->priority > curr->lock_need->holder->priority)
-		{
-			curr->lock_need->holder->priority = curr->priority;
-			curr = curr->lock_need->holder;
-		}
-		else
-			break;
-	}
+	struct thread *thread_a = heap_entry(a, struct thread, w_elem);
+	struct thread *thread_b = heap_entry(b, struct thread, w_elem);
+
+	if (thread_a->priority != thread_b->priority)
+		return thread_a->priority < thread_b->priority;
+	return thread_a->wait_seq > thread_b->wait_seq;
+}
+
+/* Orders a thread's held locks by their highest waiter priority. */
+bool cmp_lock_priority(const struct heap_elem *a, const struct heap_elem *b, void *aux UNUSED)
+{
+	struct lock *lock_a = heap_entry(a, struct lock, elem);
+	struct lock *lock_b = heap_entry(b, struct lock, elem);
+
+	return lock_a->priority < lock_b->priority;
 }
 
-void remove_with_lock(struct lock *lock)
+/* Returns the priority of the highest-priority thread waiting on
+   SEMA, or -1 if there is none. */
+static int
+sema_max_priority(const struct semaphore *sema)
+{
+	if (heap_empty(&sema->waiters))
+		return -1;
+	return heap_entry(heap_top(&sema->waiters), struct thread, w_elem)->priority;
+}
+
+/* Moves T, whose priority just changed, to its new place among the
+   waiters of the semaphore it is blocked on, if any.  Interrupts
+   must be off. */
+void sema_reorder_waiter(struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (t->sema_need != NULL)
+		heap_update(&t->sema_need->waiters, &t->w_elem);
+}
+
+/* priority donation을 수행하는 함수
+   Raises each lock in the chain that the current thread is about
+   to wait for, and each holder along the way, to the current
+   thread's priority.  Each step is a heap update, so the whole
+   chain costs O(depth * log n).  Interrupts must be off. */
+void donate_priority(void)
 {
-	/* lock을 해지 했을 때, waiters 리스트에서 해당 엔트리를 삭제 하기 위한 함수를 구현
-	현재 쓰레드의 waiters 리스트를 확인하여 해지할 lock을 보유하고 있는 엔트리를 삭제 */
 	struct thread *curr = thread_current();
-	struct list_elem *e = list_begin(&curr->donator_list);
+	int priority = curr->priority;
+	struct lock *lock = curr->lock_need;
+
+	ASSERT(intr_get_level() == INTR_OFF);
 
-	while (e != list_end(&curr->donator_list))
+	while (lock != NULL && lock->holder != NULL && priority > lock->priority)
 	{
-		struct thread *t = list_entry(e, struct thread, d_elem);
-		if (t->lock_need == lock)
-		{
-			list_remove(e);
-			/* threre might be several threads that want same lock */
-		}
-		e = list_next(e);
+		struct thread *holder = lock->holder;
+
+		lock->priority = priority;
+		heap_update(&holder->held_locks, &lock->elem);
+		if (priority <= holder->priority)
+			break;
+
+		/* Also moves HOLDER up among the waiters of the next lock. */
+		thread_change_priority(holder, priority);
+		lock = holder->lock_need;
 	}
 }
 
-/* refresh current thread's priority regarding of priority donation */
+/* refresh current thread's priority regarding of priority donation:
+   the larger of its own priority and the top of its held locks. */
 void refresh_priority(void)
 {
 	struct thread *curr = thread_current();
-	curr->priority = curr->origin_priority;
-	if (!list_empty(&curr->donator_list))
+	int priority = curr->origin_priority;
+
+	if (!heap_empty(&curr->held_locks))
 	{
-		struct thread *max_donator = list_entry(list_front(&curr->donator_list), struct thread, d_elem);
-		if (max_donator->priority > curr->priority)
-			curr->priority = max_donator->priority;
+		struct lock *top = heap_entry(heap_top(&curr->held_locks), struct lock, elem);
+		if (top->priority > priority)
+			priority = top->priority;
 	}
+	thread_change_priority(curr, priority);
 }
@@ -24,9 +24,35 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority level, and bit N of ready_bitmap is set iff
+   ready_queues[N] is non-empty, so that enqueueing, dequeueing and
+   finding the highest ready priority are all O(1). */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static size_t ready_cnt; /* # of threads in the ready queues. */
+
+/* Processes sleeping in timer_sleep(), kept in a hierarchical
+   timing wheel keyed on wakeup_tick.  Level 0 has one bucket per
+   tick for the next SLEEP_WHEEL0_SIZE ticks, and each level of
+   sleep_wheeln covers SLEEP_WHEELN_SIZE times the range of the one
+   below it.  Whenever level 0 wraps around, the due bucket of the
+   next level is cascaded down, so a sleeper is moved at most once
+   per level and the timer interrupt only touches due buckets. */
+#define SLEEP_WHEEL0_BITS 8
+#define SLEEP_WHEELN_BITS 6
+#define SLEEP_WHEEL0_SIZE (1 << SLEEP_WHEEL0_BITS)
+#define SLEEP_WHEELN_SIZE (1 << SLEEP_WHEELN_BITS)
+#define SLEEP_WHEEL0_MASK (SLEEP_WHEEL0_SIZE - 1)
+#define SLEEP_WHEELN_MASK (SLEEP_WHEELN_SIZE - 1)
+#define SLEEP_LEVELS 4 /* # of levels above level 0. */
+static struct list sleep_wheel0[SLEEP_WHEEL0_SIZE];
+static struct list sleep_wheeln[SLEEP_LEVELS][SLEEP_WHEELN_SIZE];
+static int64_t sleep_clock;		  /* Next tick the wheel will process. */
+static size_t sleep_cnt;		  /* # of sleeping threads. */
+static long long sleep_wakeups;	  /* # of sleepers woken up. */
+static long long sleep_cascades; /* # of moves down a wheel level. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -60,6 +86,12 @@ static void kernel_thread(thread_func *, void *aux);
 
 static void idle(void *aux UNUSED);
 static struct thread *next_thread_to_run(void);
+static void ready_push(struct thread *);
+static void ready_remove(struct thread *);
+static int ready_max_priority(void);
+static int mlfqs_priority(struct thread *);
+static void sleep_wheel_add(struct thread *);
+static void sleep_wheel_cascade(struct list *bucket);
 static void init_thread(struct thread *, const char *name, int priority);
 static void do_schedule(int status);
 static void schedule(void);
@@ -107,8 +139,15 @@ void thread_init(void)
 
 	/* Init the globla thread context */
 	lock_init(&tid_lock);
-	list_init(&ready_list);
-	list_init(&sleep_list);
+	for (int i = PRI_MIN; i <= PRI_MAX; i++)
+		list_init(&ready_queues[i]);
+	ready_bitmap = 0;
+	ready_cnt = 0;
+	for (int i = 0; i < SLEEP_WHEEL0_SIZE; i++)
+		list_init(&sleep_wheel0[i]);
+	for (int i = 0; i < SLEEP_LEVELS; i++)
+		for (int j = 0; j < SLEEP_WHEELN_SIZE; j++)
+			list_init(&sleep_wheeln[i][j]);
 	list_init(&destruction_req);
 	list_init(&all_list);
 
@@ -149,11 +188,11 @@ void thread_tick(void)
 		user_ticks++;
 #endif
 	else
-	{
 		kernel_ticks++;
-		int f = 1 << 14;
-		t->recent_cpu += f;
-	}
+
+	/* Only the running thread accumulates recent_cpu. */
+	if (t != idle_thread)
+		t->recent_cpu += 1 << 14;
 
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
@@ -252,8 +291,8 @@ void thread_unblock(struct thread *t)
 
 	old_level = intr_disable();
 	ASSERT(t->status == THREAD_BLOCKED);
-	list_insert_ordered(&ready_list, &t->elem, cmp_priority, NULL);
 	t->status = THREAD_READY;
+	ready_push(t);
 
 	intr_set_level(old_level);
 }
@@ -322,7 +361,7 @@ void thread_yield(void)
 
 	old_level = intr_disable();
 	if (curr != idle_thread)
-		list_insert_ordered(&ready_list, &curr->elem, cmp_priority, NULL);
+		ready_push(curr);
 	do_schedule(THREAD_READY);
 	intr_set_level(old_level);
 }
@@ -402,6 +441,16 @@ idle(void *idle_started_ UNUSED)
 		intr_disable();
 		thread_block();
 
+		/* Nothing else is ready, so spend the time zeroing free
+		   pages for later PAL_ZERO requests, one page at a time so
+		   that a thread woken by an interrupt does not wait long. */
+		intr_enable();
+		while (ready_cnt == 0 && palloc_prezero())
+			continue;
+		intr_disable();
+		if (ready_cnt > 0)
+			continue;
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -446,7 +495,8 @@ init_thread(struct thread *t, const char *name, int priority)
 	t->magic = THREAD_MAGIC;
 
 	t->lock_need = NULL;
-	list_init(&t->donator_list);
+	heap_init(&t->held_locks, cmp_lock_priority, NULL);
+	t->sema_need = NULL;
 	t->origin_priority = priority;
 
 	/* can be inherited from parent thread */
@@ -469,10 +519,78 @@ init_thread(struct thread *t, const char *name, int priority)
 static struct thread *
 next_thread_to_run(void)
 {
-	if (list_empty(&ready_list))
+	if (ready_bitmap == 0)
 		return idle_thread;
 	else
-		return list_entry(list_pop_front(&ready_list), struct thread, elem);
+	{
+		struct thread *t = list_entry(list_front(&ready_queues[ready_max_priority()]),
+									  struct thread, elem);
+		ready_remove(t);
+		return t;
+	}
+}
+
+/* Appends T to the ready queue of its current priority.
+   Interrupts must be off. */
+static void
+ready_push(struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	list_push_back(&ready_queues[t->priority], &t->elem);
+	ready_bitmap |= 1ULL << t->priority;
+	ready_cnt++;
+}
+
+/* Removes T from the ready queue of its current priority.
+   Interrupts must be off. */
+static void
+ready_remove(struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	list_remove(&t->elem);
+	if (list_empty(&ready_queues[t->priority]))
+		ready_bitmap &= ~(1ULL << t->priority);
+	ready_cnt--;
+}
+
+/* Returns the highest priority that has a ready thread, or -1 if
+   no thread is ready. */
+static int
+ready_max_priority(void)
+{
+	if (ready_bitmap == 0)
+		return -1;
+	return 63 - __builtin_clzll(ready_bitmap);
+}
+
+/* Sets T's priority to PRIORITY.  If T is waiting in the ready
+   queues, it is moved to the back of the queue for its new
+   priority; if it is blocked on a semaphore, its place among the
+   semaphore's waiters is updated. */
+void thread_change_priority(struct thread *t, int priority)
+{
+	enum intr_level old_level = intr_disable();
+
+	if (t->priority != priority)
+	{
+		if (t->status == THREAD_READY)
+		{
+			ready_remove(t);
+			t->priority = priority;
+			ready_push(t);
+		}
+		else
+		{
+			t->priority = priority;
+			if (t->status == THREAD_BLOCKED)
+				sema_reorder_waiter(t);
+		}
+	}
+
+	intr_set_level(old_level);
 }
 
 /* Use iretq to launch the thread */
@@ -646,7 +764,7 @@ allocate_tid(void)
 	return tid;
 }
 
-/* move current thread to sleep_list */
+/* Puts the current thread to sleep until timer tick TICKS. */
 void thread_sleep(int64_t ticks)
 {
 	struct thread *curr = thread_current();
@@ -659,8 +777,8 @@ void thread_sleep(int64_t ticks)
 	if (curr != idle_thread)
 	{
 		curr->wakeup_tick = ticks;
-		list_push_back(&sleep_list, &curr->elem);
-		update_next_tick_to_awake();
+		sleep_wheel_add(curr);
+		sleep_cnt++;
 
 		/* if do_schedule before save wakeup_tick, it might lead infinite loop. */
 		do_schedule(THREAD_BLOCKED);
@@ -668,25 +786,108 @@ void thread_sleep(int64_t ticks)
 	intr_set_level(old_level);
 }
 
-/* update local tick */
-void update_next_tick_to_awake()
+/* Wakes up every sleeping thread whose wakeup_tick is at or
+   before NOW.  Called by the timer interrupt on every tick. */
+void thread_awake(int64_t now)
 {
-	struct list_elem *e = list_begin(&sleep_list);
+	ASSERT(intr_get_level() == INTR_OFF);
 
-	if (e != list_end(&sleep_list))
+	/* Nothing is filed in the wheel, so it can skip ahead. */
+	if (sleep_cnt == 0)
 	{
-		struct thread *t = list_entry(e, struct thread, elem);
-		next_tick_to_awake = t->wakeup_tick;
+		sleep_clock = now + 1;
+		return;
 	}
+
+	while (sleep_clock <= now)
+	{
+		int idx = sleep_clock & SLEEP_WHEEL0_MASK;
+		struct list *bucket = &sleep_wheel0[idx];
+
+		/* Level 0 wrapped around: refill it from the next level,
+		   and that level from the one above it if it wrapped too. */
+		if (idx == 0)
+		{
+			int level, shift = SLEEP_WHEEL0_BITS;
+			for (level = 0; level < SLEEP_LEVELS; level++, shift += SLEEP_WHEELN_BITS)
+			{
+				int slot = (sleep_clock >> shift) & SLEEP_WHEELN_MASK;
+				sleep_wheel_cascade(&sleep_wheeln[level][slot]);
+				if (slot != 0)
+					break;
+			}
+		}
+
+		while (!list_empty(bucket))
+		{
+			struct thread *t = list_entry(list_pop_front(bucket), struct thread, elem);
+			if (t->wakeup_tick > now)
+			{
+				/* Parked beyond the wheel's range; file it again. */
+				sleep_wheel_add(t);
+				continue;
+			}
+			sleep_cnt--;
+			sleep_wakeups++;
+			thread_unblock(t);
+		}
+		sleep_clock++;
+	}
+}
+
+/* Stores the number of sleeping threads woken so far in *WAKEUPS
+   and the number of times a sleeper was moved down a wheel level
+   in *CASCADES. */
+void thread_sleep_stats(long long *wakeups, long long *cascades)
+{
+	enum intr_level old_level = intr_disable();
+	*wakeups = sleep_wakeups;
+	*cascades = sleep_cascades;
+	intr_set_level(old_level);
+}
+
+/* Files sleeping thread T in the timing wheel bucket for its
+   wakeup_tick.  Interrupts must be off. */
+static void
+sleep_wheel_add(struct thread *t)
+{
+	int64_t expires = t->wakeup_tick;
+	int64_t delta = expires - sleep_clock;
+	struct list *bucket;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (delta < 0)
+		/* Already due: handle it on the next tick. */
+		bucket = &sleep_wheel0[sleep_clock & SLEEP_WHEEL0_MASK];
+	else if (delta < SLEEP_WHEEL0_SIZE)
+		bucket = &sleep_wheel0[expires & SLEEP_WHEEL0_MASK];
 	else
-		next_tick_to_awake = INT64_MAX;
+	{
+		int level, shift = SLEEP_WHEEL0_BITS;
+		for (level = 0; level < SLEEP_LEVELS - 1; level++, shift += SLEEP_WHEELN_BITS)
+			if (delta < (1LL << (shift + SLEEP_WHEELN_BITS)))
+				break;
+
+		/* Too far away for the wheel: park it in the farthest
+		   bucket, it is filed again when that bucket cascades. */
+		if (delta >= (1LL << (shift + SLEEP_WHEELN_BITS)))
+			expires = sleep_clock + (1LL << (shift + SLEEP_WHEELN_BITS)) - 1;
+		bucket = &sleep_wheeln[level][(expires >> shift) & SLEEP_WHEELN_MASK];
+	}
+	list_push_back(bucket, &t->elem);
+}
 
-	while (e != list_end(&sleep_list))
+/* Re-files every thread in BUCKET, moving each of them down to a
+   finer-grained level of the timing wheel. */
+static void
+sleep_wheel_cascade(struct list *bucket)
+{
+	while (!list_empty(bucket))
 	{
-		struct thread *t = list_entry(e, struct thread, elem);
-		if (t->wakeup_tick < next_tick_to_awake)
-			next_tick_to_awake = t->wakeup_tick;
-		e = list_next(e);
+		struct thread *t = list_entry(list_pop_front(bucket), struct thread, elem);
+		sleep_cascades++;
+		sleep_wheel_add(t);
 	}
 }
 
@@ -701,7 +902,7 @@ bool cmp_priority(const struct list_elem *a, const struct list_elem *b, void *au
 		return 0;
 }
 
-/* compare priority between running thread and 1st ready_list thread */
+/* compare priority between running thread and the highest ready thread */
 void test_max_priority(void)
 {
 	if (intr_context() == true)
@@ -709,15 +910,8 @@ void test_max_priority(void)
 		return;
 	}
 
-	struct list_elem *e = list_begin(&ready_list);
-
-	if (e != list_end(&ready_list))
-	{
-		struct thread *max_ready_list = list_entry(e, struct thread, elem);
-
-		if (thread_get_priority() < max_ready_list->priority)
-			thread_yield();
-	}
+	if (thread_get_priority() < ready_max_priority())
+		thread_yield();
 }
 
 void update_load_avg(void)
@@ -726,117 +920,59 @@ void update_load_avg(void)
 	int new_load_avg;
 	int f = 1 << 14;
 	if (thread_current() == idle_thread)
-		new_load_avg = ((59 * load_avg) / 60) + (list_size(&ready_list) * f / 60);
+		new_load_avg = ((59 * load_avg) / 60) + ((int)ready_cnt * f / 60);
 	else
-		new_load_avg = ((59 * load_avg) / 60) + ((list_size(&ready_list) + 1) * f / 60);
+		new_load_avg = ((59 * load_avg) / 60) + (((int)ready_cnt + 1) * f / 60);
 	load_avg = new_load_avg;
 	return;
 }
 
+/* Decays every thread's recent_cpu once per second and moves each
+   thread whose priority changes as a result to its new ready queue.
+   This is the only point at which threads other than the running
+   one change priority under the MLFQS. */
 void update_recent_cpu(void)
 {
 	/* recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu + nice */
-	struct thread *curr = thread_current();
-	int temp;
 	int f = 1 << 14;
+	int64_t coef = (int64_t)(load_avg << 1) * f / ((load_avg << 1) + f);
+	struct list_elem *e;
 
-	// if (curr != idle_thread)
-	// {
-	// 	temp = ((int64_t)(load_avg << 1) * f / ((load_avg << 1) + f)) * (curr->recent_cpu) / f + (curr->nice) * f;
-	// 	curr->recent_cpu = temp;
-	// }
-
-	if (!list_empty(&all_list))
+	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
 	{
-		struct list_elem *e;
-		for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
+		struct thread *t = list_entry(e, struct thread, a_elem);
+		if (t != idle_thread)
 		{
-			int tmp;
-			struct thread *t = list_entry(e, struct thread, a_elem);
-			if (t != idle_thread)
-			{
-				tmp = ((int64_t)(load_avg << 1) * f / ((load_avg << 1) + f)) * (t->recent_cpu) / f + (t->nice) * f;
-				t->recent_cpu = tmp;
-			}
+			t->recent_cpu = coef * t->recent_cpu / f + t->nice * f;
+			thread_change_priority(t, mlfqs_priority(t));
 		}
 	}
-
-	// if (!list_empty(&ready_list))
-	// {
-	// 	struct list_elem *e;
-	// 	for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e))
-	// 	{
-	// 		int tmp;
-	// 		struct thread *t = list_entry(e, struct thread, elem);
-
-	// 		tmp = ((int64_t)(load_avg << 1) * f / ((load_avg << 1) + f)) * (t->recent_cpu) / f + (t->nice) * f;
-	// 		t->recent_cpu = tmp;
-	// 	}
-	// }
-
-	// if (!list_empty(&sleep_list))
-	// {
-	// 	struct list_elem *e;
-	// 	for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e))
-	// 	{
-	// 		int tmp;
-	// 		struct thread *t = list_entry(e, struct thread, elem);
-
-	// 		tmp = ((int64_t)(load_avg << 1) * f / ((load_avg << 1) + f)) * (t->recent_cpu) / f + (t->nice) * f;
-	// 		t->recent_cpu = tmp;
-	// 	}
-	// }
 }
 
+/* Recomputes the running thread's priority.  Between the decays in
+   update_recent_cpu() only the running thread's recent_cpu and nice
+   can change, so every other thread's priority is still current. */
 void update_priority(void)
 {
-	/* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2) */
 	struct thread *curr = thread_current();
-	int f = 1 << 14;
 
-	// if (curr != idle_thread)
-	// {
-	// 	int temp = (63 * f - (curr->recent_cpu / 4) - (curr->nice << 1) * f) / f;
-	// 	curr->priority = temp;
-	// }
+	if (curr != idle_thread)
+		curr->priority = mlfqs_priority(curr);
+}
 
-	if (!list_empty(&all_list))
-	{
-		struct list_elem *e;
-		for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
-		{
-			struct thread *t = list_entry(e, struct thread, a_elem);
-			if (t != idle_thread)
-			{
-				int tmp = (63 * f - t->recent_cpu / 4 - (t->nice << 1) * f) / f;
-				t->priority = tmp;
-			}
-		}
-	}
+/* Returns T's MLFQS priority, clamped to [PRI_MIN, PRI_MAX]. */
+static int
+mlfqs_priority(struct thread *t)
+{
+	/* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2) */
+	int f = 1 << 14;
+	int priority = (PRI_MAX * f - t->recent_cpu / 4 - (t->nice << 1) * f) / f;
 
-	// if (!list_empty(&ready_list))
-	// {
-	// 	struct list_elem *e;
-	// 	for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e))
-	// 	{
-	// 		struct thread *t = list_entry(e, struct thread, elem);
-	// 		int tmp = (63 * f - t->recent_cpu / 4 - (t->nice << 1) * f) / f;
-
-	// 		t->priority = tmp;
-	// 	}
-	// }
-
-	// if (!list_empty(&sleep_list))
-	// {
-	// 	struct list_elem *e;
-	// 	for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e))
-	// 	{
-	// 		struct thread *t = list_entry(e, struct thread, elem);
-	// 		int tmp = (63 * f - t->recent_cpu / 4 - (t->nice << 1) * f) / f;
-
-	// 		t->priority = tmp;
-	// 	}
-	// }
+	if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	else if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	return priority;
 }
 
 struct thread *get_child_with_pid(int pid)
@@ -19,6 +19,7 @@
 #include "threads/vaddr.h"
 #include "intrinsic.h"
 #ifdef VM
+#include "threads/malloc.h"
 #include "vm/vm.h"
 #endif
 
@@ -179,6 +180,12 @@ __do_fork(void *aux)
 		goto error;
 
 	process_activate(current);
+
+	/* The child's unloaded pages will be read from its own copy of
+	 * the executable. */
+	current->running = file_duplicate(parent->running);
+	if (current->running == NULL)
+		goto error;
 #ifdef VM
 	supplemental_page_table_init(&current->spt);
 	if (!supplemental_page_table_copy(&current->spt, &parent->spt))
@@ -242,6 +249,8 @@ int process_exec(void *f_name)
 
 	/* We first kill the current context */
 	process_cleanup();
+	file_close(thread_current()->running);
+	thread_current()->running = NULL;
 
 	char *argv[64];
 	int argc = 0;
@@ -705,12 +714,19 @@ install_page(void *upage, void *kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Reads PAGE's part of the segment, described by the struct
+ * file_load in AUX, and frees AUX.  Called on the first fault. */
 static bool
 lazy_load_segment(struct page *page, void *aux)
 {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct file_load *load = aux;
+	uint8_t *kpage = page->frame->kva;
+	bool success;
+
+	success = file_read_at(load->file, kpage, load->read_bytes, load->ofs) == (off_t)load->read_bytes;
+	memset(kpage + load->read_bytes, 0, PGSIZE - load->read_bytes);
+	free(load);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -743,16 +759,33 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
+		struct file_load *aux = malloc(sizeof *aux);
+		if (aux == NULL)
+			return false;
+		aux->file = file;
+		aux->ofs = ofs;
+		aux->read_bytes = page_read_bytes;
 		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
 											writable, lazy_load_segment, aux))
+		{
+			free(aux);
 			return false;
+		}
+		if (!writable)
+		{
+			/* Other processes running this file may already have
+			 * the page loaded; map theirs instead. */
+			struct page *page = spt_find_page(&thread_current()->spt, upage);
+			page->text_inode = file_get_inode(file);
+			page->text_ofs = ofs;
+			page->text_bytes = page_read_bytes;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -764,11 +797,13 @@ setup_stack(struct intr_frame *if_)
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	/* VM_MARKER_0 marks stack pages. */
+	if (vm_alloc_page(VM_ANON | VM_MARKER_0, stack_bottom, true))
+	{
+		success = vm_claim_page(stack_bottom);
+		if (success)
+			if_->rsp = USER_STACK;
+	}
 	return success;
 }
 #endif /* VM */
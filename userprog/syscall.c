@@ -15,12 +15,19 @@
 #include "threads/synch.h"
 #include "userprog/process.h"
 #include "threads/palloc.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
 
 bool create(const char *file, unsigned initial_size);
 bool remove(const char *file);
+#ifdef VM
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap(void *addr);
+#endif
 
 struct lock filesys_lock;
 
@@ -56,6 +63,11 @@ void syscall_init(void)
 void syscall_handler(struct intr_frame *f UNUSED)
 {
 	// TODO: Your implementation goes here.
+#ifdef VM
+	/* Page faults taken inside the kernel need the user's stack
+	 * pointer to tell stack growth from a bad access. */
+	thread_current()->user_rsp = f->rsp;
+#endif
 	switch (f->R.rax)
 	{
 	case SYS_HALT:
@@ -103,6 +115,15 @@ void syscall_handler(struct intr_frame *f UNUSED)
 	case SYS_CLOSE:
 		close(f->R.rdi);
 		break;
+#ifdef VM
+	case SYS_MMAP:
+		f->R.rax = (uint64_t) mmap((void *) f->R.rdi, f->R.rsi, f->R.rdx,
+				f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP:
+		munmap((void *) f->R.rdi);
+		break;
+#endif
 	default:
 		exit(-1);
 		break;
@@ -156,6 +177,22 @@ int filesize(int fd)
 int read(int fd, void *buffer, unsigned size)
 {
 	check_address(buffer);
+#ifdef VM
+	/* Fail here rather than in the fault handler, while holding
+	 * filesys_lock.  Every page of the buffer must be writable, not
+	 * just the first. */
+	for (uint8_t *upage = pg_round_down(buffer);
+		 size > 0 && upage < (uint8_t *)buffer + size; upage += PGSIZE)
+	{
+		void *addr = upage < (uint8_t *)buffer ? buffer : upage;
+		check_address(addr);
+		struct page *page = spt_find_page(&thread_current()->spt, addr);
+		if (page != NULL && !page->writable)
+		{
+			exit(-1);
+		}
+	}
+#endif
 	unsigned char *buf = buffer;
 	int read_size;
 	struct thread *curr = thread_current();
@@ -267,7 +304,13 @@ bool remove(const char *file)
 void check_address(void *addr)
 {
 	struct thread *curr = thread_current();
+#ifdef VM
+	/* Pages that are not loaded yet are brought in by the fault
+	 * handler; the stack may also grow into ADDR. */
+	if (addr == NULL || is_kernel_vaddr(addr) || (spt_find_page(&curr->spt, addr) == NULL && (uint64_t)addr + 8 < curr->user_rsp))
+#else
 	if (is_kernel_vaddr(addr) || pml4_get_page(curr->pml4, addr) == NULL)
+#endif
 	{
 		exit(-1);
 	}
@@ -300,3 +343,21 @@ int wait(tid_t pid)
 {
 	process_wait(pid);
 }
+
+#ifdef VM
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	struct file *file = process_get_file(fd);
+
+	if (fd < 2 || file == NULL)
+	{
+		return NULL;
+	}
+	return do_mmap(addr, length, writable, file, offset);
+}
+
+void munmap(void *addr)
+{
+	do_munmap(addr);
+}
+#endif
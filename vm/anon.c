@@ -1,7 +1,13 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +23,254 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Sectors in one swap slot, which holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* A page that starts a new run of swap is put at the start of this
+ * many free slots, so that its neighbors can follow it. */
+#define SWAP_CLUSTER 8
+
+/* Most pages read by one swap-in, counting the faulting page. */
+#define SWAP_READAHEAD 8
+
+/* Swap slots.  A set bit is a slot in use. */
+static struct bitmap *swap_map;
+static struct lock swap_lock;
+
+/* Number of pages using each slot in use.  Fork gives the child a
+ * page that is swapped out by sharing its slot. */
+static unsigned *slot_refs;
+static size_t used_slot_cnt;    /* Number of set bits in swap_map. */
+
+/* Last page swapped out, and the slot it went to. */
+static struct thread *last_owner;
+static void *last_va;
+static size_t last_slot;
+
+/* Statistics. */
+static long long swap_out_cnt;  /* Pages written to swap. */
+static long long swap_in_cnt;   /* Pages read on a fault. */
+static long long readahead_cnt; /* Pages read ahead of a fault. */
+
+static size_t slot_alloc (struct page *);
+static void slot_put (size_t slot);
+static bool slot_exclusive (size_t slot);
+static bool slots_to_spare (void);
+static void read_done (struct disk_request *);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	if (swap_disk != NULL) {
+		size_t slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+
+		swap_map = bitmap_create (slot_cnt);
+		slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+		if (swap_map == NULL || slot_refs == NULL)
+			PANIC ("swap bitmap creation failed");
+	}
+}
+
+/* Prints swap statistics. */
+void
+vm_anon_print_stats (void) {
+	printf ("Swap: %lld pages out, %lld pages in, %lld read ahead\n",
+			swap_out_cnt, swap_in_cnt, readahead_cnt);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SLOT_NONE;
+	return true;
+}
+
+/* Picks a swap slot for PAGE and marks it used.  A page that follows
+ * the page swapped out just before it, in the same address space,
+ * goes to the next slot, so that runs of pages end up in runs of
+ * slots.  Returns SLOT_NONE if swap is full. */
+static size_t
+slot_alloc (struct page *page) {
+	size_t slot_cnt = bitmap_size (swap_map);
+	size_t slot;
+
+	lock_acquire (&swap_lock);
+	slot = last_slot + 1;
+	if (page->owner != last_owner || page->va != (uint8_t *) last_va + PGSIZE
+			|| slot >= slot_cnt || bitmap_test (swap_map, slot)) {
+		slot = bitmap_scan (swap_map, 0, SWAP_CLUSTER, false);
+		if (slot == BITMAP_ERROR)
+			slot = bitmap_scan (swap_map, 0, 1, false);
+	}
+	if (slot != BITMAP_ERROR) {
+		bitmap_mark (swap_map, slot);
+		slot_refs[slot] = 1;
+		used_slot_cnt++;
+		last_owner = page->owner;
+		last_va = page->va;
+		last_slot = slot;
+	} else
+		slot = SLOT_NONE;
+	lock_release (&swap_lock);
+	return slot;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Drops a page's use of SLOT, and marks it free if that was the
+ * last. */
+static void
+slot_put (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (slot_refs[slot] > 0);
+	if (--slot_refs[slot] == 0) {
+		bitmap_reset (swap_map, slot);
+		used_slot_cnt--;
+	}
+	lock_release (&swap_lock);
+}
+
+/* Returns true if pages in memory may keep their swap slots, which
+ * is so until swap is more than three quarters full.  Reads
+ * used_slot_cnt without swap_lock, as it is only a hint. */
+static bool
+slots_to_spare (void) {
+	return used_slot_cnt < bitmap_size (swap_map) / 4 * 3;
+}
+
+/* Returns true if no page but the caller's uses SLOT. */
+static bool
+slot_exclusive (size_t slot) {
+	bool exclusive;
+
+	lock_acquire (&swap_lock);
+	exclusive = slot_refs[slot] == 1;
+	lock_release (&swap_lock);
+	return exclusive;
+}
+
+/* Makes DST, a new anonymous page, a copy of SRC, an anonymous page
+ * that is swapped out, by sharing SRC's swap slot.  Each page reads
+ * the slot on its own first fault. */
+void
+anon_share_slot (struct page *dst, struct page *src) {
+	ASSERT (dst->operations == &anon_ops && dst->anon.slot == SLOT_NONE);
+	ASSERT (src->operations == &anon_ops && src->anon.slot != SLOT_NONE);
+
+	lock_acquire (&swap_lock);
+	slot_refs[src->anon.slot]++;
+	lock_release (&swap_lock);
+	dst->anon.slot = src->anon.slot;
+}
+
+/* Completion function for a swap read.  Runs in the disk daemon. */
+static void
+read_done (struct disk_request *r) {
+	sema_up (r->aux);
+}
+
+/* Swap in the page by read contents from the swap disk.
+ * The pages of the same address space that follow PAGE in both
+ * memory and swap are read along with it, into frames that are free
+ * without eviction, so that a run of swapped pages comes back in one
+ * sequential pass over the disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct disk_request requests[SWAP_READAHEAD];
+	struct page *pages[SWAP_READAHEAD];
+	struct semaphore done;
+	size_t cnt, i;
+
+	if (anon_page->slot == SLOT_NONE)
+		return true;
+
+	pages[0] = page;
+	for (cnt = 1; cnt < SWAP_READAHEAD; cnt++) {
+		uint8_t *va = (uint8_t *) page->va + cnt * PGSIZE;
+		struct page *next;
+
+		if (!is_user_vaddr (va))
+			break;
+		next = spt_find_page (&page->owner->spt, va);
+		if (next == NULL || next->operations != &anon_ops
+				|| next->frame != NULL
+				|| next->anon.slot != anon_page->slot + cnt
+				|| !vm_prefetch_frame (next))
+			break;
+		pages[cnt] = next;
+	}
+
+	sema_init (&done, 0);
+	for (i = 0; i < cnt; i++) {
+		disk_request_init (&requests[i], swap_disk,
+				pages[i]->anon.slot * SECTORS_PER_SLOT,
+				i == 0 ? kva : pages[i]->frame->kva, SECTORS_PER_SLOT, false,
+				read_done, &done);
+		disk_submit (&requests[i]);
+	}
+	for (i = 0; i < cnt; i++)
+		sema_down (&done);
+
+	/* Each page keeps its slot, so that it need not be written again
+	 * unless it changes, while swap has room. */
+	for (i = 0; i < cnt; i++) {
+		if (!slots_to_spare ()) {
+			slot_put (pages[i]->anon.slot);
+			pages[i]->anon.slot = SLOT_NONE;
+		}
+		if (i > 0)
+			vm_unpin_frame (pages[i]->frame);
+	}
+	swap_in_cnt++;
+	readahead_cnt += cnt - 1;
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * A page that still has the slot it was swapped in from, and has
+ * not been written since, is already there.  A changed page is
+ * written over its slot, unless fork shared the slot, in which case
+ * it gets a slot of its own. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (swap_map == NULL)
+		return false;
+	if (anon_page->slot != SLOT_NONE) {
+		if (!pml4_is_dirty (page->owner->pml4, page->va))
+			return true;
+		if (!slot_exclusive (anon_page->slot)) {
+			slot_put (anon_page->slot);
+			anon_page->slot = SLOT_NONE;
+		}
+	}
+	if (anon_page->slot == SLOT_NONE) {
+		anon_page->slot = slot_alloc (page);
+		if (anon_page->slot == SLOT_NONE)
+			return false;
+	}
+	disk_write_multiple (swap_disk, anon_page->slot * SECTORS_PER_SLOT,
+			page->frame->kva, SECTORS_PER_SLOT);
+	swap_out_cnt++;
+	vm_count_write_back ();
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* Freeing the frame first waits out an eviction that is still
+	 * choosing a slot. */
+	vm_free_frame (page, false);
+	if (anon_page->slot != SLOT_NONE)
+		slot_put (anon_page->slot);
 }
@@ -1,10 +1,16 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static bool lazy_load_file (struct page *page, void *aux);
+static bool write_back (struct page *page);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -25,34 +31,177 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	/* Set up the handler */
 	page->operations = &file_ops;
 
+	/* lazy_load_file() fills in the rest. */
 	struct file_page *file_page = &page->file;
+	file_page->file = NULL;
+	return true;
+}
+
+/* Loads PAGE for the first time from the struct file_load in AUX,
+ * which it frees. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	struct file_load *load = aux;
+	struct file_page *file_page = &page->file;
+
+	file_page->file = load->file;
+	file_page->ofs = load->ofs;
+	file_page->read_bytes = load->read_bytes;
+	free (load);
+
+	return file_backed_swap_in (page, page->frame->kva);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->read_bytes,
+				file_page->ofs) != (off_t) file_page->read_bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->read_bytes, 0,
+			PGSIZE - file_page->read_bytes);
+	return true;
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (write_back (page))
+		vm_count_write_back ();
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	vm_free_frame (page, true);
+}
+
+/* Writes PAGE back to its file if the user has modified it.
+ * Returns true if it was written. */
+static bool
+write_back (struct page *page) {
+	struct file_page *file_page = &page->file;
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (page->frame == NULL || !pml4_is_dirty (pml4, page->va))
+		return false;
+	file_write_at (file_page->file, page->frame->kva, file_page->read_bytes,
+			file_page->ofs);
+	pml4_set_dirty (pml4, page->va, false);
+	return true;
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct mmap_region *region, *r;
+	struct list_elem *e;
+	off_t file_len;
+	size_t mapped;
+	uint8_t *upage;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || pg_ofs (offset) != 0
+			|| length == 0 || offset < 0)
+		return NULL;
+	if ((uintptr_t) addr + length < (uintptr_t) addr
+			|| !is_user_vaddr ((uint8_t *) addr + length - 1))
+		return NULL;
+	if (!spt_range_free (spt, addr, length))
+		return NULL;
+
+	file_len = file_length (file);
+	if (file_len <= offset)
+		return NULL;
+
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return NULL;
+	region->file = file_reopen (file);
+	if (region->file == NULL) {
+		free (region);
+		return NULL;
+	}
+	region->start = addr;
+	region->end = pg_round_up ((uint8_t *) addr + length);
+
+	for (upage = addr, mapped = 0; mapped < length;
+			upage += PGSIZE, mapped += PGSIZE) {
+		struct file_load *load = malloc (sizeof *load);
+		off_t ofs = offset + mapped;
+		size_t left = ofs < file_len ? file_len - ofs : 0;
+
+		if (load == NULL)
+			goto fail;
+		load->file = region->file;
+		load->ofs = ofs;
+		load->read_bytes = left < PGSIZE ? left : PGSIZE;
+		if (!vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					lazy_load_file, load)) {
+			free (load);
+			goto fail;
+		}
+	}
+
+	/* Keep the regions ordered by address. */
+	for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+			e = list_next (e)) {
+		r = list_entry (e, struct mmap_region, elem);
+		if (r->start > region->start)
+			break;
+	}
+	list_insert (e, &region->elem);
+	return addr;
+
+fail:
+	while (upage > (uint8_t *) addr) {
+		upage -= PGSIZE;
+		spt_remove_page (spt, spt_find_page (spt, upage));
+	}
+	file_close (region->file);
+	free (region);
+	return NULL;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct mmap_region *region = mmap_find_region (spt, addr);
+	uint8_t *upage;
+
+	if (region == NULL || region->start != addr)
+		return;
+
+	/* Destroying a page writes it back if it is dirty. */
+	for (upage = region->start; upage < (uint8_t *) region->end;
+			upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+	list_remove (&region->elem);
+	file_close (region->file);
+	free (region);
+}
+
+/* Returns the mmap region of SPT that contains VA, or a null
+ * pointer if there is none. */
+struct mmap_region *
+mmap_find_region (struct supplemental_page_table *spt, const void *va) {
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+			e = list_next (e)) {
+		struct mmap_region *r = list_entry (e, struct mmap_region, elem);
+		if (va < r->start)
+			break;
+		if (va < r->end)
+			return r;
+	}
+	return NULL;
 }
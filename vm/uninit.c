@@ -8,6 +8,7 @@
  * function.
  * */
 
+#include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -56,13 +57,29 @@ uninit_initialize (struct page *page, void *kva) {
 		(init ? init (page, aux) : true);
 }
 
+/* Transmutes PAGE like uninit_initialize(), but without running its
+ * initialization callback, because its contents are already at KVA.
+ * Frees the callback's aux. */
+bool
+uninit_initialize_loaded (struct page *page, void *kva) {
+	struct uninit_page *uninit = &page->uninit;
+	void *aux = uninit->aux;
+
+	ASSERT (page->operations == &uninit_ops);
+
+	free (aux);
+	return uninit->page_initializer (page, uninit->type, kva);
+}
+
 /* Free the resources hold by uninit_page. Although most of pages are transmuted
  * to other page objects, it is possible to have uninit pages when the process
  * exit, which are never referenced during the execution.
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* The initializer never ran, so the aux it would have freed is
+	 * still ours. */
+	free (uninit->aux);
 }
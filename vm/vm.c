@@ -1,9 +1,41 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "filesys/inode.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Lowest address the stack may grow down to. */
+#define STACK_LIMIT (USER_STACK - (1 << 20))
+
+/* Every frame that holds a user page, in clock order.  The clock
+ * hand points at the next frame to consider for eviction. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+static struct condition frame_idle;  /* Signaled when a frame stops
+                                        being busy. */
+
+/* Frames holding read-only text, by inode and offset.  Protected by
+ * frame_lock. */
+static struct hash text_frames;
+static uint64_t text_hash (const struct hash_elem *, void *);
+static bool text_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+
+/* Statistics. */
+static long long evict_cnt;     /* Frames evicted. */
+static long long write_cnt;     /* Evicted frames written to disk. */
+static long long scan_cnt;      /* Frames looked at by the clock. */
+static long long cow_share_cnt; /* Pages shared copy-on-write by fork. */
+static long long cow_copy_cnt;  /* Shared pages copied on a write. */
+static long long text_share_cnt; /* Text pages mapped to a loaded frame. */
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +47,28 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+	cond_init (&frame_idle);
+	hash_init (&text_frames, text_hash, text_less, NULL);
+	clock_hand = NULL;
+}
+
+/* Prints frame eviction statistics. */
+void
+vm_print_stats (void) {
+	printf ("Frames: %lld evicted, %lld written back, %lld scanned\n",
+			evict_cnt, write_cnt, scan_cnt);
+	printf ("Copy-on-write: %lld pages shared, %lld copied\n",
+			cow_share_cnt, cow_copy_cnt);
+	printf ("Text: %lld pages shared\n", text_share_cnt);
+	vm_anon_print_stats ();
+}
+
+/* Counts a frame that its page's swap_out() wrote to disk. */
+void
+vm_count_write_back (void) {
+	write_cnt++;
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,6 +89,23 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static struct frame *frame_alloc (bool may_evict);
+static void frame_table_remove (struct frame *);
+static struct frame *page_frame (struct page *);
+static bool frame_write_out (struct frame *, struct page *);
+static void frame_link (struct frame *, struct page *);
+static void frame_unlink (struct frame *, struct page *);
+static void frame_free (struct frame *);
+static bool unloaded_segment (struct page *);
+static bool copy_unloaded (struct page *src);
+static bool share_frame (struct page *src, struct page *dst);
+static bool text_share (struct page *);
+static void text_publish (struct frame *, struct page *);
+static void text_unpublish (struct frame *);
+static uint64_t page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static void page_kill (struct hash_elem *, void *);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,11 +120,33 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
-
-		/* TODO: Insert the page into the spt. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, pg_round_down (upage), init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
+		page->text_inode = NULL;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
@@ -62,80 +154,491 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
+/* Removes PAGE from SPT and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Returns true if no page of the LENGTH bytes starting at VA is in
+ * SPT, nor in one of its mmap regions. */
+bool
+spt_range_free (struct supplemental_page_table *spt, void *va,
+		size_t length) {
+	uint8_t *start = pg_round_down (va);
+	uint8_t *end = (uint8_t *) va + length;
+	struct list_elem *e;
+	uint8_t *p;
+
+	for (e = list_begin (&spt->regions); e != list_end (&spt->regions);
+			e = list_next (e)) {
+		struct mmap_region *r = list_entry (e, struct mmap_region, elem);
+		if ((uint8_t *) r->start >= end)
+			break;
+		if ((uint8_t *) r->end > start)
+			return false;
+	}
+	for (p = start; p < end; p += PGSIZE)
+		if (spt_find_page (spt, p) != NULL)
+			return false;
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns a hash value for page E. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct page, spt_elem)->va
+		< hash_entry (b, struct page, spt_elem)->va;
+}
+
+/* Get the struct frame, that will be evicted.
+ * This is the clock algorithm: a frame whose page was accessed since
+ * the hand last passed gets a second chance.  Among the frames that
+ * were not accessed, clean ones are taken first, because their file
+ * or swap slot usually holds them already, so evicting them needs no
+ * write; the first dirty one is remembered and taken if
+ * a whole turn of the clock finds no clean one.  Frames shared
+ * copy-on-write are passed over. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-
-	return victim;
+	struct frame *dirty = NULL;
+	size_t frame_cnt = list_size (&frame_table);
+	size_t scanned;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (scanned = 0; scanned < 2 * frame_cnt; scanned++) {
+		struct frame *frame;
+		uint64_t *pml4;
+		void *va;
+
+		if (dirty != NULL && scanned >= frame_cnt)
+			break;
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+
+		if (frame->pin_cnt > 0 || frame->ref_cnt > 1)
+			continue;
+		pml4 = frame->page->owner->pml4;
+		va = frame->page->va;
+		if (pml4_is_accessed (pml4, va))
+			pml4_set_accessed (pml4, va, false);
+		else if (!pml4_is_dirty (pml4, va)) {
+			scan_cnt += scanned + 1;
+			return frame;
+		} else if (dirty == NULL)
+			dirty = frame;
+	}
+	scan_cnt += scanned;
+	return dirty;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ * A victim that cannot be written out, say because swap is full, is
+ * mapped back, and the clock moves on to the next one. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-
+	size_t tries;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (tries = list_size (&frame_table); tries > 0; tries--) {
+		struct frame *victim = vm_get_victim ();
+		struct page *page;
+		uint64_t *pml4;
+		bool dirty;
+
+		if (victim == NULL)
+			return NULL;
+		page = victim->page;
+		pml4 = page->owner->pml4;
+		dirty = pml4_is_dirty (pml4, page->va);
+
+		text_unpublish (victim);
+		pml4_clear_page (pml4, page->va);
+		if (frame_write_out (victim, page)) {
+			frame_unlink (victim, page);
+			frame_table_remove (victim);
+			evict_cnt++;
+			return victim;
+		}
+
+		/* Clearing the mapping kept the dirty bit, which setting it
+		 * again does not. */
+		pml4_set_page (pml4, page->va, victim->kva, page->writable);
+		if (dirty)
+			pml4_set_dirty (pml4, page->va, true);
+	}
 	return NULL;
 }
 
+/* Swaps out PAGE, which FRAME holds and which is no longer mapped.
+ * frame_lock is released meanwhile, so that other faults, and file
+ * system code that faults on user buffers, do not wait behind the
+ * write.  FRAME is marked busy, so that nothing else uses it until
+ * the write is done; see page_frame().  Call with frame_lock held.
+ * Returns true if PAGE was written out. */
+static bool
+frame_write_out (struct frame *frame, struct page *page) {
+	bool written;
+
+	ASSERT (!frame->busy);
+
+	frame->busy = true;
+	frame->pin_cnt++;
+	lock_release (&frame_lock);
+	written = swap_out (page);
+	lock_acquire (&frame_lock);
+	frame->pin_cnt--;
+	frame->busy = false;
+	cond_broadcast (&frame_idle, &frame_lock);
+	return written;
+}
+
+/* Returns PAGE's frame, or a null pointer if it has none, after
+ * waiting for any write out of the frame to finish.  Call with
+ * frame_lock held. */
+static struct frame *
+page_frame (struct page *page) {
+	while (page->frame != NULL && page->frame->busy)
+		cond_wait (&frame_idle, &frame_lock);
+	return page->frame;
+}
+
+/* Removes FRAME from the frame table, moving the clock hand off it. */
+static void
+frame_table_remove (struct frame *frame) {
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+}
+
+/* Maps FRAME to PAGE, as far as the frame table is concerned. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+	if (frame->page == NULL)
+		frame->page = page;
+	page->frame = frame;
+}
+
+/* Undoes frame_link(). */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	list_remove (&page->frame_elem);
+	frame->ref_cnt--;
+	if (frame->page == page)
+		frame->page = frame->ref_cnt > 0
+			? list_entry (list_front (&frame->pages), struct page, frame_elem)
+			: NULL;
+	page->frame = NULL;
+}
+
+/* Frees FRAME, which no page uses any more. */
+static void
+frame_free (struct frame *frame) {
+	ASSERT (frame->ref_cnt == 0);
+
+	frame_table_remove (frame);
+	text_unpublish (frame);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Returns a hash value for the text of frame E. */
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *frame = hash_entry (e, struct frame, text_elem);
+	return hash_bytes (&frame->text_inode, sizeof frame->text_inode)
+		^ hash_int (frame->text_ofs) ^ hash_int (frame->text_bytes);
+}
+
+/* Returns true if the text of frame A precedes that of frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, text_elem);
+	const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+	if (a->text_inode != b->text_inode)
+		return a->text_inode < b->text_inode;
+	if (a->text_ofs != b->text_ofs)
+		return a->text_ofs < b->text_ofs;
+	return a->text_bytes < b->text_bytes;
+}
+
+/* If another process has PAGE's text loaded, maps PAGE to the same
+ * frame, read-only, and returns true.  Only a page that was never
+ * loaded is shared; one that was, and got evicted, has its own copy
+ * in swap. */
+static bool
+text_share (struct page *page) {
+	struct frame key, *frame = NULL;
+	struct hash_elem *e;
+
+	if (VM_TYPE (page->operations->type) != VM_UNINIT)
+		return false;
+
+	key.text_inode = page->text_inode;
+	key.text_ofs = page->text_ofs;
+	key.text_bytes = page->text_bytes;
+	lock_acquire (&frame_lock);
+	e = hash_find (&text_frames, &key.text_elem);
+	if (e != NULL) {
+		frame = hash_entry (e, struct frame, text_elem);
+		if (!uninit_initialize_loaded (page, frame->kva)
+				|| !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					false))
+			frame = NULL;
+		else {
+			frame_link (frame, page);
+			text_share_cnt++;
+		}
+	}
+	lock_release (&frame_lock);
+	return frame != NULL;
+}
+
+/* Makes FRAME, just loaded with PAGE's text, available to other
+ * processes running the same file. */
+static void
+text_publish (struct frame *frame, struct page *page) {
+	lock_acquire (&frame_lock);
+	frame->text_inode = page->text_inode;
+	frame->text_ofs = page->text_ofs;
+	frame->text_bytes = page->text_bytes;
+	if (hash_insert (&text_frames, &frame->text_elem) == NULL)
+		/* Keep the inode, and so its address, while the key is
+		 * in use. */
+		inode_reopen (frame->text_inode);
+	else
+		frame->text_inode = NULL;
+	lock_release (&frame_lock);
+}
+
+/* Withdraws FRAME's text from sharing, if it has any.  Call with
+ * frame_lock held. */
+static void
+text_unpublish (struct frame *frame) {
+	if (frame->text_inode == NULL)
+		return;
+	hash_delete (&text_frames, &frame->text_elem);
+	inode_close (frame->text_inode);
+	frame->text_inode = NULL;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is returned pinned, so that it is not evicted before the
+ * caller has filled it. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame = frame_alloc (true);
+
+	if (frame == NULL)
+		PANIC ("out of user frames");
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
+/* Returns a new frame, pinned and in the frame table, or a null
+ * pointer if there is none.  If MAY_EVICT is true, a frame is evicted
+ * when the user pool is empty. */
+static struct frame *
+frame_alloc (bool may_evict) {
+	struct frame *frame = NULL;
+	void *kva;
+
+	lock_acquire (&frame_lock);
+	/* User pages are handed out zeroed, which the idle thread makes
+	 * cheap. */
+	kva = palloc_get_page (PAL_USER | PAL_ZERO);
+	if (kva != NULL) {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			PANIC ("out of memory for frames");
+		frame->kva = kva;
+		frame->page = NULL;
+		list_init (&frame->pages);
+		frame->ref_cnt = 0;
+		frame->busy = false;
+		frame->text_inode = NULL;
+	} else if (may_evict)
+		frame = vm_evict_frame ();
+	if (frame != NULL) {
+		frame->pin_cnt = 1;
+		list_push_back (&frame_table, &frame->elem);
+	}
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Gives PAGE, which must not be resident, a frame for reading it in
+ * ahead of a fault, and maps it.  Only a free frame is used; nothing
+ * is evicted for a page that may never be touched.  The frame is
+ * returned pinned, and the caller unpins it with vm_unpin_frame()
+ * once it is filled.  Returns a null pointer if there is no free
+ * frame. */
+struct frame *
+vm_prefetch_frame (struct page *page) {
+	struct frame *frame;
+
+	ASSERT (page->frame == NULL);
+
+	frame = frame_alloc (false);
+	if (frame == NULL)
+		return NULL;
+	frame_link (frame, page);
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		vm_free_frame (page, false);
+		return NULL;
+	}
+	return frame;
+}
+
+/* Lets FRAME be evicted again. */
+void
+vm_unpin_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->pin_cnt--;
+	lock_release (&frame_lock);
+}
+
 /* Growing the stack. */
-static void
-vm_stack_growth (void *addr UNUSED) {
+static bool
+vm_stack_growth (void *addr) {
+	return vm_alloc_page (VM_ANON | VM_MARKER_0, pg_round_down (addr), true)
+		&& vm_claim_page (addr);
+}
+
+/* Releases PAGE's frame, if it has one, and unmaps it from its
+ * owner's address space.  If WRITE_BACK is true, swaps the page out
+ * first.  Waits for an eviction of the page that is under way, so the
+ * two cannot race.  A frame that other pages still share is only
+ * unmapped. */
+void
+vm_free_frame (struct page *page, bool write_back) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame = page_frame (page);
+	if (frame != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		if (write_back && frame->ref_cnt == 1)
+			frame_write_out (frame, page);
+		frame_unlink (frame, page);
+		if (frame->ref_cnt == 0)
+			frame_free (frame);
+	}
+	lock_release (&frame_lock);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * PAGE is writable but shares its frame copy-on-write, so it gets a
+ * copy of the frame of its own.  If the other sharers have gone
+ * meanwhile, the frame is simply made writable. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+	struct frame *old, *new = NULL;
+
+	lock_acquire (&frame_lock);
+	old = page_frame (page);
+	if (old == NULL) {
+		/* Evicted before we got the lock; fault it back in. */
+		lock_release (&frame_lock);
+		return vm_do_claim_page (page);
+	}
+	if (old->ref_cnt > 1) {
+		/* Allocating may evict; keep OLD meanwhile. */
+		old->pin_cnt++;
+		lock_release (&frame_lock);
+		new = vm_get_frame ();
+		lock_acquire (&frame_lock);
+		old->pin_cnt--;
+	}
+
+	pml4_clear_page (pml4, page->va);
+	if (old->ref_cnt > 1) {
+		memcpy (new->kva, old->kva, PGSIZE);
+		frame_unlink (old, page);
+		frame_link (new, page);
+		new->pin_cnt--;
+		cow_copy_cnt++;
+	} else if (new != NULL) {
+		new->pin_cnt--;
+		frame_free (new);
+	}
+	pml4_set_page (pml4, page->va, page->frame->kva, true);
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	struct page *page;
+	uintptr_t rsp;
+
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (!not_present) {
+		/* Writing a page shared copy-on-write. */
+		if (page != NULL && write && page->writable)
+			return vm_handle_wp (page);
+		return false;
+	}
+
+	if (page == NULL) {
+		/* A push may fault a little below the stack pointer.  In a
+		 * system call, the user's stack pointer was saved on entry. */
+		rsp = user ? f->rsp : t->user_rsp;
+		if ((uintptr_t) addr >= STACK_LIMIT && (uintptr_t) addr < USER_STACK
+				&& (uintptr_t) addr + 8 >= rsp)
+			return vm_stack_growth (addr);
+		return false;
+	}
+	if (write && !page->writable)
+		return false;
 
 	return vm_do_claim_page (page);
 }
@@ -150,9 +653,10 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+	if (page == NULL)
+		return false;
 
 	return vm_do_claim_page (page);
 }
@@ -160,31 +664,179 @@ vm_claim_page (void *va UNUSED) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	bool load_text;
+
+	/* If PAGE faulted while being evicted, and the eviction failed,
+	 * it is mapped again. */
+	lock_acquire (&frame_lock);
+	frame = page_frame (page);
+	lock_release (&frame_lock);
+	if (frame != NULL)
+		return true;
+
+	if (page->text_inode != NULL && text_share (page))
+		return true;
+	load_text = page->text_inode != NULL
+		&& VM_TYPE (page->operations->type) == VM_UNINIT;
+	frame = vm_get_frame ();
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	frame_link (frame, page);
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)
+			|| !swap_in (page, frame->kva)) {
+		vm_free_frame (page, false);
+		return false;
+	}
+	if (load_text)
+		text_publish (frame, page);
 
-	return swap_in (page, frame->kva);
+	/* Now the frame may be evicted. */
+	vm_unpin_frame (frame);
+	return true;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+	list_init (&spt->regions);
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.
+ * Runs in the child, whose executable must already be open as its
+ * RUNNING file.  Only pages that are in memory cost a frame: pages
+ * of the executable that were never loaded stay unloaded, and
+ * swapped out pages stay in swap. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *src_page = hash_entry (hash_cur (&i), struct page,
+				spt_elem);
+		struct page *dst_page;
+
+		if (unloaded_segment (src_page)) {
+			if (!copy_unloaded (src_page))
+				return false;
+			continue;
+		}
+		if (!vm_alloc_page (VM_ANON, src_page->va, src_page->writable))
+			return false;
+		dst_page = spt_find_page (dst, src_page->va);
+		if (!share_frame (src_page, dst_page))
+			return false;
+	}
+	return true;
+}
+
+/* Returns true if PAGE is part of its process's executable and was
+ * never loaded, so that it still reads itself from the executable
+ * on its first fault. */
+static bool
+unloaded_segment (struct page *page) {
+	struct file_load *load;
+
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON
+			|| page->uninit.aux == NULL)
+		return false;
+	load = page->uninit.aux;
+	return load->file == page->owner->running;
+}
+
+/* Gives the current process an unloaded copy of SRC, a page of its
+ * parent for which unloaded_segment() is true, that reads itself
+ * from the current process's own executable. */
+static bool
+copy_unloaded (struct page *src) {
+	struct file_load *aux = malloc (sizeof *aux);
+	struct page *dst;
+
+	if (aux == NULL)
+		return false;
+	*aux = *(struct file_load *) src->uninit.aux;
+	aux->file = thread_current ()->running;
+	if (!vm_alloc_page_with_initializer (VM_ANON, src->va, src->writable,
+				src->uninit.init, aux)) {
+		free (aux);
+		return false;
+	}
+	dst = spt_find_page (&thread_current ()->spt, src->va);
+	dst->text_inode = src->text_inode;
+	dst->text_ofs = src->text_ofs;
+	dst->text_bytes = src->text_bytes;
+	return true;
+}
+
+/* Gives DST, a new anonymous page of the current process, the
+ * contents of SRC, a page of its parent.  Anonymous pages share SRC's
+ * frame copy-on-write, or its swap slot if it is swapped out.  A
+ * file-backed page is copied, because its dirty bit, which says
+ * whether to write it back, must survive. */
+static bool
+share_frame (struct page *src, struct page *dst) {
+	bool copy = page_get_type (src) != VM_ANON;
+
+	/* Turn DST into an anonymous page, and give it a frame of its own
+	 * if it is to be a copy. */
+	if (!swap_in (dst, NULL) || (copy && !vm_do_claim_page (dst)))
+		return false;
+
+	/* Claiming frames may evict SRC's, so check under the lock. */
+	lock_acquire (&frame_lock);
+	if (!copy && page_frame (src) == NULL
+			&& VM_TYPE (src->operations->type) == VM_ANON
+			&& src->anon.slot != SLOT_NONE) {
+		anon_share_slot (dst, src);
+		lock_release (&frame_lock);
+		return true;
+	}
+	while (page_frame (src) == NULL) {
+		lock_release (&frame_lock);
+		if (!vm_do_claim_page (src))
+			return false;
+		lock_acquire (&frame_lock);
+	}
+	if (copy)
+		memcpy (dst->frame->kva, src->frame->kva, PGSIZE);
+	else {
+		frame_link (src->frame, dst);
+		if (src->writable) {
+			/* Keep the dirty bit, which says whether SRC's swap slot,
+			 * if it has one, is stale. */
+			bool dirty = pml4_is_dirty (src->owner->pml4, src->va);
+
+			pml4_set_page (src->owner->pml4, src->va, src->frame->kva, false);
+			if (dirty)
+				pml4_set_dirty (src->owner->pml4, src->va, true);
+		}
+		pml4_set_page (dst->owner->pml4, dst->va, src->frame->kva, false);
+		cow_share_cnt++;
+	}
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	/* Unmapping writes the mapped files back. */
+	while (!list_empty (&spt->regions)) {
+		struct mmap_region *r = list_entry (list_front (&spt->regions),
+				struct mmap_region, elem);
+		do_munmap (r->start);
+	}
+	hash_clear (&spt->pages, page_kill);
+}
+
+/* Destroys the page that contains E, for hash_clear(). */
+static void
+page_kill (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
 }